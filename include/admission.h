@@ -0,0 +1,55 @@
+#ifndef ADMISSION_H
+#define ADMISSION_H
+
+#include "icssh.h"
+
+#define QUEUE_ERR "QUEUE ERROR: No queued job at that position.\n"
+#define CLASS_ERR "QUEUE ERROR: Priority class must be 0 (high), 1 (normal) or 2 (low).\n"
+
+// Priority classes of queued jobs; lower runs first
+#define ADMISSION_CLASSES 3
+#define ADMISSION_DEFAULT_CLASS 1
+
+/*
+ * With the admission queue on (-q), background jobs over the max_bgprocs
+ * limit wait in a queue instead of being rejected with BG_ERR. They are
+ * launched by priority class, first come first served within a class,
+ * as slots free up.
+ */
+void enable_admission_queue(void);
+
+bool admission_queue_enabled(void);
+
+/*
+ * Queues job in the default class; the queue owns it from now on.
+ */
+void queue_bg_job(job_info* job);
+
+/*
+ * Takes the job next in line off the queue; NULL if the queue is empty.
+ */
+job_info* dequeue_bg_job(void);
+
+int queued_bg_jobs(void);
+
+/*
+ * Lists the queued jobs in launch order, after the running ones in bglist.
+ */
+void print_admission_queue(FILE* fp);
+
+/*
+ * Frees every queued job without running it.
+ */
+void clear_admission_queue(void);
+
+/*
+ * bgcancel [position]: drops one queued job, or all of them.
+ */
+void handle_bgcancel_command(job_info* job);
+
+/*
+ * bgprio position class: moves a queued job to another priority class.
+ */
+void handle_bgprio_command(job_info* job);
+
+#endif
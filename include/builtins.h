@@ -0,0 +1,21 @@
+#ifndef BUILTINS_H
+#define BUILTINS_H
+
+#include "icssh.h"
+
+/*
+ * Utilities that are cheap enough to run inside the shell instead of forking:
+ * echo, true, false, printf, test, [ and pwd.
+ */
+bool is_simple_builtin(char* cmd);
+
+/*
+ * Runs a foreground job whose only process is a simple builtin.
+ * out_file/append/err_file are applied by temporarily redirecting the shell's
+ * own descriptors, which are restored afterwards.
+ * Returns the exit status a child running the utility would have had.
+ * Does not free job.
+ */
+int run_simple_builtin(job_info* job);
+
+#endif
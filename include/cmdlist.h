@@ -0,0 +1,53 @@
+#ifndef CMDLIST_H
+#define CMDLIST_H
+
+#include <stdbool.h>
+
+/*
+ * Command lists: jobs joined by ;, &, && and ||, grouped with ( ).
+ * The parser library only takes a single job per line, so lines using
+ * these operators are split here and each job is parsed on its own
+ * when its turn comes.
+ *
+ * && and || bind tighter than ; and &, all of them left to right.
+ * A job followed by & runs in the background; a group can't be.
+ * Groups run in the shell itself, not in a subshell. Redirections after a
+ * group's ) apply to everything in it.
+ */
+typedef enum {
+	CMD_JOB,    // text holds one job for validate_input
+	CMD_SEQ,    // left, then right
+	CMD_AND,    // right if left succeeded
+	CMD_OR,     // right if left failed
+	CMD_GROUP,  // left with the redirections in text
+} cmd_kind_t;
+
+typedef struct cmd_list {
+	cmd_kind_t kind;
+	char* text;
+	struct cmd_list* left;
+	struct cmd_list* right;
+} cmd_list_t;
+
+/*
+ * Parses line into a command list.
+ * Returns NULL with *error false if line is a plain job (at most a trailing &),
+ * and NULL with *error true, after printing a parse error, if it is malformed.
+ */
+cmd_list_t* parse_command_list(const char* line, bool* error);
+
+/*
+ * Runs list, handing each job's text to run_job; run_job returns false if
+ * the shell has to exit, which stops the list. *status is the exit status
+ * the && and || decisions look at.
+ * A redirected group runs between redirect(text, saved), which returns false
+ * if the redirections can't be applied (the group is then skipped with
+ * status 1), and restore(saved).
+ * Returns false if the shell has to exit.
+ */
+bool run_command_list(cmd_list_t* list, bool (*run_job)(char* text), bool (*redirect)(char* text, int* saved),
+                      void (*restore)(int* saved), int* status);
+
+void free_command_list(cmd_list_t* list);
+
+#endif
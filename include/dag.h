@@ -0,0 +1,27 @@
+#ifndef DAG_H
+#define DAG_H
+
+#include "icssh.h"
+#include "jobtable.h"
+
+/*
+ * dag [-j jobs] file
+ *
+ * Runs the nodes of a make-like file:
+ *
+ *     name: dependency dependency ...
+ *         command
+ *         command
+ *
+ * A node starts once all of its dependencies succeeded and runs its commands
+ * one after the other; up to jobs nodes run at a time (default: one per online
+ * CPU). When a command fails its node fails and everything depending on it is
+ * skipped. Lines starting with # are comments.
+ * Prints each node's result and time, the critical path and the wall time to
+ * stderr. Background jobs finishing meanwhile are reaped as usual.
+ * Sets the exit status to 0 if every node succeeded, 1 if not and 2 if the
+ * file is malformed (unknown dependency, cycle, ...).
+ */
+void handle_dag_command(job_info* job, job_table_t* bg_job_list, int* last_child_status);
+
+#endif
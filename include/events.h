@@ -0,0 +1,67 @@
+#ifndef EVENTS_H
+#define EVENTS_H
+
+#include <signal.h>
+#include <stdbool.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+
+/*
+ * SIGCHLD is blocked in the shell and read from a signalfd instead, so the
+ * main loop can poll for it next to its input and never miss one between
+ * checking and blocking.
+ * Returns 0 on success, -1 with errno set on failure.
+ */
+int init_child_events(void);
+
+/*
+ * The signalfd; readable while a child has changed state and
+ * drain_child_events() hasn't been called since.
+ */
+int child_events_fd(void);
+
+/*
+ * Consumes the pending SIGCHLDs without blocking.
+ * Returns true if there were any, i.e. some child may be waiting to be reaped.
+ */
+bool drain_child_events(void);
+
+/*
+ * The signal mask the shell started with, for the programs it runs.
+ */
+const sigset_t* child_sigmask(void);
+
+/*
+ * Timers. All of them share one timerfd armed for the earliest deadline,
+ * so the main loop polls a single descriptor however many are pending.
+ * A timer fires once; periodic work adds itself again from its callback.
+ */
+typedef struct shell_timer shell_timer_t;
+
+/*
+ * Calls fn(arg) once ms milliseconds have passed on CLOCK_MONOTONIC.
+ * Returns a handle for cancel_timer, valid until the timer has fired.
+ */
+shell_timer_t* add_timer(long ms, void (*fn)(void*), void* arg);
+
+void cancel_timer(shell_timer_t* timer);
+
+/*
+ * The timerfd; readable once the earliest timer is due.
+ */
+int timer_events_fd(void);
+
+/*
+ * Calls every timer that is due, without blocking.
+ */
+void run_due_timers(void);
+
+/*
+ * Waits for any child like wait4(-1, status, 0, usage), running timers that
+ * fall due in the meantime. SIGCHLDs consumed here are remembered, so
+ * drain_child_events() still reports children that are left unreaped.
+ * Returns the pid, or -1 with errno set (ECHILD if there are no children).
+ */
+pid_t wait_child(int* status, struct rusage* usage);
+
+#endif
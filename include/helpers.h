@@ -2,36 +2,59 @@
 // Declare any additional functions in this file
 #include "linkedlist.h"
 #include "icssh.h"
+#include "jobtable.h"
 #include <string.h>
 
 
 
 int is_builtin_command(char* line);
 
-int handle_exit_command(job_info* job, list_t* bg_job_list);
+int handle_exit_command(job_info* job, job_table_t* bg_job_list);
 
 void handle_cd_command(job_info* job);
 
 void handle_estatus_command(job_info* job, int last_child_status);
 
-void handle_bglist_command(job_info* job, list_t* bg_job_list);
+void handle_exec_command(job_info* job, int* last_child_status);
+
+void handle_bglist_command(job_info* job, job_table_t* bg_job_list);
 
 int compare_bgentry(const void* a, const void* b);
 
-bgentry_t* find_bg_job_by_pid(list_t* bg_job_list, pid_t pid);
+bgentry_t* find_bg_job_by_pid(job_table_t* bg_job_list, pid_t pid);
+
+void free_bgentry(bgentry_t* entry);
+
+// Called by remove_process_from_list after a job is gone, if set
+extern void (*job_removed_hook)(void);
+
+void remove_process_from_list(job_table_t* bg_job_list, bgentry_t* entry);
+
+void reap_child(job_table_t* bg_job_list, pid_t pid, int status, const struct rusage* usage, int* last_child_status);
+
+void reap_terminated_children(job_table_t* bg_job_list , int* child_terminated, int* last_child_status );
 
-void remove_process_from_list(list_t* bg_job_list, pid_t pid);
+void handle_fg_command(job_info* job, job_table_t* bg_job_list, int* last_child_status);
 
-void reap_terminated_children(list_t* bg_job_list , int* child_terminated, int* last_child_status );
+void handle_bg_process(job_info* job, job_table_t* bg_job_list, pid_t* pids, int n);
 
-void handle_fg_command(job_info* job, list_t* bg_job_list);
+void handle_fg_process(job_info* job, job_table_t* bg_job_list, int* last_child_status, 	pid_t pid);
 
-void handle_bg_process(job_info* job, list_t* bg_job_list, pid_t pid);
+// Drops the first count words of proc, which becomes the command after them (for prefixes)
+void shift_words(proc_info* proc, int count);
 
-void handle_fg_process(job_info* job, list_t* bg_job_list, int* last_child_status, 	pid_t pid);
+// Writes the whole content of the regular file (or memfd) src_fd to dest_fd
+void copy_file_to(int src_fd, int dest_fd);
 
-void execute_child_process(job_info* job);
+// Called by wait_for_processes before it blocks, if set
+extern void (*wait_hook)(void);
 
-void handle_single_pipe(job_info* job, int* last_child_status, list_t* bg_job_list);
+/*
+ * Waits for every process in pids; what they used is added to usage unless it is NULL.
+ * Each one is set to -1 in pids once reaped, with its wait status in statuses;
+ * entries that aren't positive are skipped and keep whatever statuses holds.
+ */
+void wait_for_processes(job_table_t* bg_job_list, pid_t* pids, int n, int* statuses, job_usage_t* usage,
+                        int* last_child_status);
 
-void handle_two_pipes(job_info* job, int* last_child_status, list_t* bg_job_list);
\ No newline at end of file
+void handle_pipeline(job_info* job, int* last_child_status, job_table_t* bg_job_list);
\ No newline at end of file
@@ -11,6 +11,7 @@
 #include <unistd.h>
 
 #include "linkedlist.h"
+#include "usage.h"
 
 
 #define RD_ERR "REDIRECTION ERROR: Invalid operators or file combination.\n"
@@ -49,8 +50,16 @@ typedef struct {
 
 typedef struct bgentry {
 	job_info *job;   // the job that the bgentry refers to
-	pid_t pid;       // pid of the (first) background process
+	pid_t pid;       // pid of the (first) background process, also its process group
 	time_t seconds;  // time at which the command recieved by the shell
+	pid_t *pids;     // every process of the job; -1 once reaped
+	int npids;       // number of entries in pids
+	int nlive;       // processes not reaped yet
+	int status;      // wait status of the last process, once reaped
+	bool throttled;  // stopped by the load throttler
+	struct job_timeout *timeout;  // time limit, NULL if none
+	job_usage_t usage;  // resources used by the processes reaped so far
+	struct node *node;  // handle of the entry in the job table's recency list
 } bgentry_t;
 
 /*
@@ -82,6 +91,4 @@ void print_bgentry(bgentry_t *p);
  */
 void sigsegv_handler();
 
-void sigchld_handler(int sig);
-
 #endif
\ No newline at end of file
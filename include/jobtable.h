@@ -0,0 +1,68 @@
+#ifndef JOBTABLE_H
+#define JOBTABLE_H
+
+#include "icssh.h"
+#include "linkedlist.h"
+
+// Initial number of slots of the pid index, a power of two
+#define JOB_TABLE_MIN_SLOTS 64
+
+typedef struct {
+	pid_t pid;          // 0 if the slot was never used, -1 if it was freed
+	bgentry_t* entry;
+} job_slot_t;
+
+/*
+ * The background jobs. Every live process of a job is found through an
+ * open addressing index keyed by pid; the jobs themselves are kept in a
+ * doubly linked list by recency, most recent first, for bglist and fg.
+ * Insertion, lookup and removal are O(1).
+ */
+typedef struct {
+	list_t* jobs;       // bgentry_t, most recent first
+	job_slot_t* slots;
+	size_t capacity;    // slots allocated, a power of two
+	size_t used;        // slots holding a pid or freed since the last rehash
+} job_table_t;
+
+job_table_t* create_job_table(void);
+
+/*
+ * Adds entry as the most recent job and indexes the pids of its processes.
+ */
+void job_table_insert(job_table_t* table, bgentry_t* entry);
+
+/*
+ * Returns the job that pid is a process of, or NULL.
+ */
+bgentry_t* job_table_find(job_table_t* table, pid_t pid);
+
+/*
+ * Stops finding entry through pid, once that process has been reaped.
+ */
+void job_table_forget_pid(job_table_t* table, bgentry_t* entry, pid_t pid);
+
+/*
+ * Unlinks entry and drops what is left of it from the index.
+ * The entry itself isn't freed.
+ */
+void job_table_remove(job_table_t* table, bgentry_t* entry);
+
+/*
+ * Prints every job with print_bgentry, most recent first; jobs stopped by
+ * the throttler are marked.
+ */
+void print_job_table(job_table_t* table, FILE* fp);
+
+/*
+ * Prints every job with print_usage_entry, most recent first. The CPU time
+ * of processes still running is read from /proc.
+ */
+void print_job_table_usage(job_table_t* table, FILE* fp);
+
+/*
+ * Frees the table; the entries have to be freed by the caller.
+ */
+void free_job_table(job_table_t* table);
+
+#endif
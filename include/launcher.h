@@ -0,0 +1,76 @@
+#ifndef LAUNCHER_H
+#define LAUNCHER_H
+
+#include "icssh.h"
+
+/*
+ * Descriptors a launched process gets as stdin, stdout and stderr.
+ * -1 means the process inherits the shell's descriptor.
+ */
+typedef struct {
+	int in_fd;
+	int out_fd;
+	int err_fd;
+} redir_t;
+
+/*
+ * Opens the redirection files of one process of a job in the shell.
+ * in_file only applies to the first process and out_file to the last one.
+ * Prints RD_ERR for conflicting or unreadable files, or why an output file
+ * can't be opened, and returns -1 on failure, in which case nothing is left open.
+ */
+int open_redirections(job_info* job, proc_info* proc, bool first, bool last, redir_t* rd);
+
+/*
+ * Closes every descriptor held by rd and resets it to inherit.
+ */
+void close_redirections(redir_t* rd);
+
+/*
+ * Starts proc with posix_spawn, so the shell's address space is never copied.
+ * The executable is resolved through the path cache and handed to the spawn
+ * server when it is running. Python script runs may be served by the zygote.
+ * An executable the kernel refuses with ENOEXEC (a script without #!) is run
+ * with /bin/sh, as execvp would.
+ * pgid -1 keeps the child in the shell's process group, 0 makes it the leader
+ * of a new one, anything else is the group to join.
+ * Returns the pid of the child, or -1 with errno set if it could not be executed.
+ */
+pid_t launch_process(proc_info* proc, redir_t* rd, pid_t pgid);
+
+/*
+ * Launches a single process job with its redirections applied.
+ * A background job is put in a process group of its own.
+ * Reports failures with RD_ERR/EXEC_ERR and returns -1.
+ */
+pid_t launch_job(job_info* job);
+
+/*
+ * Launches every process of job in one pass, connected with O_CLOEXEC pipes.
+ * The processes of a background job share one process group.
+ * pids receives job->nproc entries, -1 for a stage that could not be executed.
+ * Returns -1 without launching anything if a redirection fails.
+ */
+int launch_pipeline(job_info* job, pid_t* pids);
+
+/*
+ * Applies job's redirections to the shell's own stdin/stdout/stderr.
+ * If saved is not NULL the replaced descriptors are kept there for
+ * restore_shell, otherwise the redirection is permanent.
+ * Reports errors like open_redirections and returns -1.
+ */
+int redirect_shell(job_info* job, int* saved);
+
+/*
+ * Undoes redirect_shell.
+ */
+void restore_shell(int* saved);
+
+/*
+ * Replaces the shell with the single process of job, after applying its
+ * redirections. Only returns if that failed, with EXEC_ERR/RD_ERR reported
+ * and the shell's descriptors restored.
+ */
+int exec_job(job_info* job);
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef LINEREADER_H
+#define LINEREADER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Bytes requested from the kernel per read
+#define LINE_READER_BLOCK (64 * 1024)
+
+/*
+ * Buffered line source for non-interactive input. Reads large blocks and
+ * hands out lines split in place, without readline's per-character work.
+ */
+typedef struct {
+	int fd;        // -1 for a string source
+	char* buf;
+	size_t cap;    // allocated size of buf
+	size_t start;  // first byte not handed out yet
+	size_t end;    // one past the last byte read
+	bool eof;      // fd has nothing more to give
+	bool regular;  // fd is a regular file, so reading never blocks
+} line_reader_t;
+
+/*
+ * Creates a reader over fd; the reader doesn't close it.
+ */
+line_reader_t* fd_line_reader(int fd);
+
+/*
+ * Creates a reader over a copy of s (for -c).
+ */
+line_reader_t* string_line_reader(const char* s);
+
+/*
+ * Returns the next line without its newline, or NULL at end of input.
+ * The line lives in the reader's buffer and is valid until the next call.
+ */
+char* read_line(line_reader_t* r);
+
+/*
+ * True if read_line can return a line without blocking: one is buffered
+ * already or the input is a regular file.
+ */
+bool line_reader_has_line(line_reader_t* r);
+
+/*
+ * True if read_line would return NULL, found out without consuming input.
+ */
+bool line_reader_exhausted(line_reader_t* r);
+
+/*
+ * True if nothing is left to read on fd right now and nothing ever will be:
+ * the offset is at the end of a regular file, or a pipe's writer has hung up
+ * with nothing buffered.
+ */
+bool fd_exhausted(int fd);
+
+void free_line_reader(line_reader_t* r);
+
+/*
+ * The reader of a script piped to the shell, NULL if stdin isn't one.
+ * It has buffered stdin ahead, so a builtin reading stdin must read from it.
+ */
+extern line_reader_t* stdin_line_reader;
+
+#endif
@@ -12,22 +12,28 @@
  *
  * value - a pointer to the data of the node. 
  * next - a pointer to the next node in the list. 
+ * prev - a pointer to the previous node in the list, if the list keeps back links.
  */
 typedef struct node {
     void* data;
     struct node* next;
+    struct node* prev;
 } node_t;
 
 /*
  * Structure for the base linkedList
  * 
  * head - a pointer to the first node in the list. NULL if length is 0.
+ * tail - a pointer to the last node in the list. NULL if length is 0.
  * length - the current length of the linkedList. Must be initialized to 0.
+ * back_links - whether prev is maintained; RemoveNode is O(1) only if it is.
  * comparator - function pointer to linkedList comparator. Must be initialized!
  */
 typedef struct list {
     node_t* head;
+    node_t* tail;
     int length;
+    bool back_links;
     /* the comparator uses the values of the nodes directly (i.e function has to be type aware) */
     int (*comparator)(const void*, const void*);
     void (*printer)(void*, void*);  // function pointer for printing the data stored
@@ -39,9 +45,20 @@ typedef struct list {
 // Functions implemented/provided in linkedList.c
 list_t* CreateList(int (*compare)(const void*, const void*), void (*print)(void*,void*),
                    void (*delete)(void*));
-void InsertAtHead(list_t* list, void* val_ref);
-void InsertAtTail(list_t* list, void* val_ref);
-void InsertInOrder(list_t* list, void* val_ref);
+
+/*
+ * Turns on back links for an empty list, e.g. right after CreateList.
+ */
+void KeepBackLinks(list_t* list);
+
+/*
+ * Each of these functions inserts val_ref into the list.
+ * InsertInOrder keeps equal values in insertion order.
+ * @return a handle to the new node for RemoveNode, NULL if nothing was inserted
+ */
+node_t* InsertAtHead(list_t* list, void* val_ref);
+node_t* InsertAtTail(list_t* list, void* val_ref);
+node_t* InsertInOrder(list_t* list, void* val_ref);
 
 /*
  * Each of these functions removes a single linkedList node from
@@ -53,6 +70,13 @@ void* RemoveFromHead(list_t* list);
 void* RemoveFromTail(list_t* list);
 void* RemoveByIndex(list_t* list, int index);
 
+/*
+ * Removes the node a handle returned by one of the insert functions refers to.
+ * O(1) with back links, otherwise the list is walked for the predecessor.
+ * @return the data of the removed node
+ */
+void* RemoveNode(list_t* list, node_t* node);
+
 /* 
  * Free all nodes from the linkedList
  *
@@ -61,7 +85,8 @@ void* RemoveByIndex(list_t* list, int index);
 void DeleteList(list_t* list);
 
 /* 
- * Sort the linkedList based on the comparator value
+ * Sort the linkedList based on the comparator value, in place.
+ * Stable merge sort, O(n log n); node handles stay valid.
  *
  * @param list pointer to the linkedList struct
  */
@@ -0,0 +1,23 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include "icssh.h"
+#include "jobtable.h"
+
+/*
+ * parallel [-j jobs] [-k] [-X] [-s] [-a file] command [args]
+ *
+ * Runs command once per line of input (the file given with -a, the job's
+ * < redirection, or stdin), keeping up to jobs children running (default:
+ * one per online CPU). {} in an argument is replaced by the item; without
+ * any {} the item is appended.
+ *  -k  print each command's output in input order
+ *  -X  pack as many items into one command as ARG_MAX allows, repeating
+ *      each argument that contains {} once per item
+ *  -s  print every item's exit status to stderr once all are done
+ * Background jobs finishing meanwhile are reaped as usual.
+ * Sets the exit status to the number of failed commands, at most 101.
+ */
+void handle_parallel_command(job_info* job, job_table_t* bg_job_list, int* last_child_status);
+
+#endif
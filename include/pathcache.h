@@ -0,0 +1,42 @@
+#ifndef PATHCACHE_H
+#define PATHCACHE_H
+
+#include "icssh.h"
+
+// How long a "command not found" answer is trusted, in milliseconds
+#define HASH_NEGATIVE_TTL_MS 1000
+
+/*
+ * Resolves cmd to the path that should be executed.
+ * Commands containing a '/' are returned as is, anything else is searched
+ * in PATH once and remembered until PATH changes.
+ * Returns NULL if cmd was not found; the pointer stays valid until the
+ * cache is modified.
+ */
+const char* lookup_command(const char* cmd);
+
+/*
+ * Drops the cached entry for cmd, e.g. after executing its cached path failed.
+ */
+void forget_command(const char* cmd);
+
+/*
+ * Drops entries resolved through relative PATH directories; called after cd.
+ */
+void path_cache_cwd_changed(void);
+
+/*
+ * Drops every entry.
+ */
+void clear_path_cache(void);
+
+/*
+ * The hash builtin:
+ *   hash          list cached commands with their hit counts
+ *   hash -r       forget everything
+ *   hash -d name  forget name
+ *   hash name...  look up and remember each name
+ */
+void handle_hash_command(job_info* job);
+
+#endif
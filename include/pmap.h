@@ -0,0 +1,21 @@
+#ifndef PMAP_H
+#define PMAP_H
+
+#include "icssh.h"
+#include "jobtable.h"
+
+// Chunks are never made smaller than this, so small inputs use fewer copies
+#define PMAP_MIN_CHUNK (64 * 1024)
+
+/*
+ * pmap [-j copies] command [args] [| command ...] < in_file [> out_file]
+ *
+ * Splits in_file (or stdin, if it is a regular file) into roughly equal
+ * chunks on line boundaries and feeds each to its own copy of the pipeline
+ * (default: one per online CPU). The copies' outputs are concatenated in
+ * input order, so a line filter scales across cores unchanged.
+ * Sets the exit status to the highest one among the copies' last commands.
+ */
+void handle_pmap_command(job_info* job, job_table_t* bg_job_list, int* last_child_status);
+
+#endif
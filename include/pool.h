@@ -0,0 +1,44 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+// Objects carved out of each slab
+#define POOL_SLAB_OBJECTS 128
+
+/*
+ * A fixed size object pool. Objects are carved out of slabs of
+ * POOL_SLAB_OBJECTS and recycled through a free list, so long sessions
+ * don't scatter small blocks over the heap. Slabs are never given back.
+ * Building with NO_POOLS (make POOLS=0) turns pool_alloc/pool_free into
+ * plain malloc/free, keeping the statistics, for comparison.
+ */
+typedef struct pool {
+	const char* name;
+	size_t size;        // object size, at least a pointer
+	void* free_list;    // recycled objects, linked through their first word
+	char* next;         // next never used object of the newest slab
+	char* end;          // end of the newest slab
+	void* slabs;        // every slab, linked through its first word
+	size_t live;        // objects handed out and not freed
+	size_t peak;        // highest live so far
+	size_t nslabs;
+	struct pool* registered;  // next pool in the list print_pool_stats walks
+	int listed;
+} pool_t;
+
+#define POOL_INITIALIZER(name, type) \
+	{ (name), sizeof(type) < sizeof(void*) ? sizeof(void*) : sizeof(type), \
+	  NULL, NULL, NULL, NULL, 0, 0, 0, NULL, 0 }
+
+void* pool_alloc(pool_t* pool);
+
+void pool_free(pool_t* pool, void* object);
+
+/*
+ * Prints live, peak and slab counts of every pool used so far.
+ */
+void print_pool_stats(FILE* fp);
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef PROBES_H
+#define PROBES_H
+
+/*
+ * USDT probes for perf, bpftrace and SystemTap, provider icssh:
+ *
+ *   command_parsed  (line, nproc)          a job was parsed
+ *   spawn_start     (cmd, argc)            a process is about to be started
+ *   exec_failed     (cmd, errno)           it could not be
+ *   stage_launched  (pid, stage, cmd)      a job's process started; stage is
+ *                                          its place in the pipeline
+ *   child_reaped    (pid, status, us)      a child was waited for, us after
+ *                                          its job was launched or, for one
+ *                                          brought back with fg, resumed
+ *   bg_inserted     (pid, jobs)            a background job entered the job
+ *   bg_removed      (pid, jobs)            table or left it; jobs is how many
+ *                                          are in it afterwards
+ *
+ * A probe is a single nop until a tracer attaches to it; its arguments are
+ * still computed, so they are kept cheap. Without <sys/sdt.h>, or built
+ * with make PROBES=0, the probes and their arguments compile to nothing.
+ * See rsrc/cmdlatency.bt for a per-command latency histogram.
+ */
+
+#if !defined(NO_PROBES) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define HAVE_PROBES
+#endif
+#endif
+
+#ifdef HAVE_PROBES
+#define PROBE2(name, a, b) DTRACE_PROBE2(icssh, name, a, b)
+#define PROBE3(name, a, b, c) DTRACE_PROBE3(icssh, name, a, b, c)
+#else
+#define PROBE2(name, a, b) do { } while (0)
+#define PROBE3(name, a, b, c) do { } while (0)
+#endif
+
+#endif
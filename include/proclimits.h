@@ -0,0 +1,40 @@
+#ifndef PROCLIMITS_H
+#define PROCLIMITS_H
+
+#include "icssh.h"
+
+#define RUN_USAGE "run: usage: run [--cpus list] [--nice n] [--rss size] command [args] | run -d [options]\n"
+#define RUN_CPUS_ERR "run: no usable CPU in %s\n"
+
+/*
+ * What a job's processes are started with (CPU affinity, niceness, memory
+ * limit), applied in each child before exec.
+ */
+typedef struct proc_limits proc_limits_t;
+
+/*
+ * Limits of the job being started, NULL if it has none.
+ * Set by take_job_limits for every job, read by the launcher.
+ */
+extern const proc_limits_t* job_limits;
+
+/*
+ * Works out the limits of job before it runs: a leading
+ * "run [--cpus list] [--nice n] [--rss size]" is taken off its first
+ * process, otherwise background jobs get the session default.
+ * CPU lists are like 0,2,4-7; sizes take a K, M or G suffix.
+ * --rss caps the address space (RLIMIT_AS), as Linux doesn't enforce RLIMIT_RSS.
+ * "run -d [options]" sets the session default (no options clear it) and a
+ * lone "run" prints it; both are handled here, the job is freed and false is
+ * returned, as it is after a usage error. Otherwise returns true.
+ */
+bool take_job_limits(job_info* job, int* last_child_status);
+
+/*
+ * Applies limits to the calling process; meant for a child about to exec.
+ * Only makes system calls, so it is safe after vfork.
+ * Returns 0, or -1 with errno set.
+ */
+int apply_proc_limits(const proc_limits_t* limits);
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef SHSTAT_H
+#define SHSTAT_H
+
+#include <stdint.h>
+
+#include "icssh.h"
+
+/*
+ * Latency histogram buckets: under 1us, then one per power of two of
+ * microseconds, the last one open ended (4.2s and up).
+ */
+#define STAT_BUCKETS 24
+
+/*
+ * What the shell has done since it started. Only the shell's main flow
+ * updates these; the SIGUSR2 handler reads them, a word at a time.
+ */
+typedef struct {
+    unsigned long commands;       // jobs run, builtins included
+    unsigned long spawns;         // processes started
+    unsigned long exec_failures;  // processes that could not be started
+    unsigned long bg_launched;
+    unsigned long bg_reaped;      // background jobs that finished, fg'd ones included
+    int bg_peak;                  // most background jobs at once, like the job list's length
+    unsigned long spawn_us[STAT_BUCKETS];  // time to start a process
+    unsigned long wait_us[STAT_BUCKETS];   // time spent waiting for a foreground job
+} shell_stats_t;
+
+extern shell_stats_t shell_stats;
+
+// CLOCK_MONOTONIC in nanoseconds, for stat_latency
+uint64_t stat_clock(void);
+
+/*
+ * Counts the time from start (a stat_clock reading) to now in histogram.
+ */
+void stat_latency(unsigned long* histogram, uint64_t start);
+
+/*
+ * Writes every counter as a "name value" line to fd, with empty histogram
+ * buckets left out. Async-signal-safe: formats by hand into a stack
+ * buffer and only calls write().
+ */
+void write_shell_stats(int fd);
+
+/*
+ * SIGUSR2 handler: write_shell_stats to stderr.
+ */
+void sigusr2_handler(int sig);
+
+/*
+ * shstat: write_shell_stats to stdout.
+ */
+void handle_shstat_command(job_info* job);
+
+#endif
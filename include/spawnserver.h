@@ -0,0 +1,35 @@
+#ifndef SPAWNSERVER_H
+#define SPAWNSERVER_H
+
+#include "icssh.h"
+#include "launcher.h"
+
+// Setting this environment variable to 1 starts the shell with a spawn server
+#define SPAWN_SERVER_ENV "ICSSH_SPAWN_SERVER"
+
+// Requests bigger than this are spawned by the shell itself
+#define SPAWN_SERVER_MAX_MSG (64 * 1024)
+
+/*
+ * Forks the spawn server: a small helper that launches processes on behalf of
+ * the shell, so spawn cost doesn't grow with the shell's heap.
+ * Must be called before the shell grows or installs signal handlers.
+ * Returns 0 on success, -1 if the shell has to launch processes itself.
+ */
+int start_spawn_server(void);
+
+/*
+ * Returns true if the spawn server is up.
+ */
+bool spawn_server_running(void);
+
+/*
+ * Asks the spawn server to start path with argv and the descriptors in rd,
+ * in process group pgid (see launch_process).
+ * The new process is created with CLONE_PARENT, so it is a child of the shell
+ * and is waited for like any other.
+ * Returns the pid, or -1 with errno set (ENOSPC if the request is too big).
+ */
+pid_t spawn_server_launch(const char* path, char** argv, redir_t* rd, pid_t pgid);
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef THROTTLE_H
+#define THROTTLE_H
+
+#include "icssh.h"
+#include "jobtable.h"
+
+// Sampling period and thresholds until throttle is given others
+#define THROTTLE_INTERVAL_MS 1000
+#define THROTTLE_CPU_PCT 50.0
+#define THROTTLE_MEM_PCT 20.0
+
+// Jobs are resumed once pressure is below this fraction of every threshold
+#define THROTTLE_RESUME_FRACTION 0.5
+
+/*
+ * throttle [-c cpu%] [-m mem%] [-l load] [-i ms] | throttle off | throttle
+ *
+ * Samples the "some avg10" line of /proc/pressure/cpu and
+ * /proc/pressure/memory every interval, or the 1 minute load average where
+ * PSI isn't available (the load threshold defaults to the number of online
+ * CPUs). While pressure is over a threshold the newest running background
+ * job is stopped with SIGSTOP, one per sample; once it is low again the
+ * oldest stopped job is resumed with SIGCONT, one per sample.
+ * Without arguments prints the settings. off resumes every stopped job.
+ */
+void handle_throttle_command(job_info* job, job_table_t* bg_job_list);
+
+/*
+ * Resumes entry if the throttler stopped it, e.g. before it is waited for.
+ */
+void unthrottle_job(bgentry_t* entry);
+
+#endif
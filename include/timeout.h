@@ -0,0 +1,55 @@
+#ifndef TIMEOUT_H
+#define TIMEOUT_H
+
+#include "icssh.h"
+
+// Exit status of a job that ran out of time, like timeout(1)
+#define TIMEOUT_STATUS 124
+
+// Time between SIGTERM and SIGKILL unless -k says otherwise
+#define TIMEOUT_GRACE_MS 2000
+
+#define TIMEOUT_USAGE "timeout: usage: timeout [-k grace] duration command [args] | timeout -d duration [-k grace]\n"
+
+/*
+ * Limits of the job being started, in milliseconds; 0 means none.
+ * Set by take_job_timeout for every job, read where its processes are launched.
+ */
+extern long job_timeout_ms;
+extern long job_grace_ms;
+
+/*
+ * Works out the time limit of job before it runs: a leading
+ * "timeout [-k grace] duration" is taken off its first process, otherwise the
+ * session default applies. Durations are numbers with an optional ms, s, m
+ * or h suffix (seconds by default). The limit covers every process the
+ * shell starts for the job, background or not; builtins run unlimited.
+ * "timeout -d duration [-k grace]" sets the session default (0 turns it off)
+ * and a lone "timeout" prints it; both are handled here, the job is freed and
+ * false is returned, as it is after a usage error. Otherwise returns true.
+ */
+bool take_job_timeout(job_info* job, int* last_child_status);
+
+typedef struct job_timeout job_timeout_t;
+
+/*
+ * Arms the current job_timeout_ms for the n processes in pids (-1 entries are
+ * skipped). If pgid is positive the process group is signalled instead.
+ * When the time is up they get SIGTERM, and SIGKILL job_grace_ms later.
+ * pids must stay valid until stop_job_timeout.
+ * Returns NULL if the job has no time limit.
+ */
+job_timeout_t* start_job_timeout(pid_t* pids, int n, pid_t pgid);
+
+/*
+ * Disarms and frees t (which may be NULL).
+ * Returns true if the job ran out of time.
+ */
+bool stop_job_timeout(job_timeout_t* t);
+
+/*
+ * True if the job t belongs to ran out of time.
+ */
+bool job_timed_out(job_timeout_t* t);
+
+#endif
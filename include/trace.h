@@ -0,0 +1,65 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "icssh.h"
+
+// Setting this environment variable to a file name traces the session into it
+#define TRACE_ENV "ICSSH_TRACE"
+
+// Events kept; older ones are overwritten
+#define TRACE_RING_EVENTS 65536
+
+#define TRACE_USAGE "trace: usage: trace [on [file] | off | flush [file]]\n"
+
+/*
+ * Phase tracing. Each traced phase is recorded as a complete event (start,
+ * duration, one number of context) in a ring buffer in memory, and written
+ * out as Chrome trace_event JSON, which chrome://tracing and Perfetto open.
+ * Recording takes a slot with an atomic increment and never blocks or
+ * allocates. Building with NO_TRACE (make TRACE=0) compiles it all out.
+ */
+extern bool tracing;
+
+// CLOCK_MONOTONIC in nanoseconds
+uint64_t trace_now(void);
+
+// Records the phase name (a string literal) from start until now
+void trace_record(const char* name, uint64_t start, long arg);
+
+#ifdef NO_TRACE
+#define TRACE_START() ((uint64_t)0)
+#define TRACE_SPAN(name, start, arg) ((void)(start))
+#else
+#define TRACE_START() (tracing ? trace_now() : 0)
+#define TRACE_SPAN(name, start, arg) do { if (tracing && (start) != 0) trace_record(name, start, arg); } while (0)
+#endif
+
+/*
+ * Starts recording; path is where the trace goes on exit, NULL to only
+ * write it with trace flush. Returns 0, or -1 if tracing is compiled out.
+ */
+int start_tracing(const char* path);
+
+/*
+ * Writes the recorded events to path (NULL for the file given to
+ * start_tracing), oldest first. Returns 0, or -1 with errno set.
+ */
+int flush_trace(const char* path);
+
+/*
+ * Writes the trace to its file if it has one; for the end of the session.
+ */
+void finish_tracing(void);
+
+/*
+ * trace on [file]  starts recording
+ * trace off        stops recording, keeping what was recorded
+ * trace flush [file] writes the recorded events now
+ * trace            prints whether it is on and how many events it holds
+ */
+void handle_trace_command(job_info* job);
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef USAGE_H
+#define USAGE_H
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <time.h>
+
+// Finished background jobs bglist -t still shows
+#define FINISHED_JOBS_KEPT 16
+
+/*
+ * What a job's processes used, summed over the ones reaped so far
+ * (wait4 reports each process once, when it is reaped).
+ */
+typedef struct {
+	struct timespec start;  // CLOCK_MONOTONIC, when the job was launched
+	struct timespec end;    // when its last process was reaped; zero while it runs
+	double user;            // CPU seconds
+	double sys;
+	long maxrss;            // KiB, of the biggest process
+	long nvcsw;             // voluntary context switches
+	long nivcsw;            // involuntary ones
+} job_usage_t;
+
+void usage_start(job_usage_t* usage);
+
+/*
+ * Adds one reaped process's rusage; usage may be NULL.
+ */
+void usage_add(job_usage_t* usage, const struct rusage* ru);
+
+void usage_end(job_usage_t* usage);
+
+/*
+ * Seconds from start to end, or to now while the job runs.
+ */
+double usage_elapsed(const job_usage_t* usage);
+
+/*
+ * CPU seconds of the processes in pids that are still running, from /proc.
+ */
+double live_cpu_seconds(const pid_t* pids, int n);
+
+/*
+ * Usage of the last foreground job, reset by time before it runs the job.
+ */
+extern job_usage_t fg_usage;
+
+/*
+ * Prints the real, user and system times, max RSS and context switches of
+ * usage, with real time taken from start to now, like the time keyword.
+ */
+void print_time_report(FILE* fp, const job_usage_t* usage);
+
+/*
+ * Remembers a background job that has finished, for bglist -t;
+ * the oldest one is forgotten once FINISHED_JOBS_KEPT are kept.
+ */
+void record_finished_job(const char* line, pid_t pid, time_t seconds, int status, bool timed_out,
+                         const job_usage_t* usage);
+
+/*
+ * Prints one line of bglist -t: start time, pid, state, elapsed, CPU time,
+ * max RSS and the command line, tab separated.
+ */
+void print_usage_entry(FILE* fp, time_t seconds, pid_t pid, const char* state, double cpu,
+                       const job_usage_t* usage, const char* line);
+
+/*
+ * Prints the finished jobs bglist -t shows, most recent first.
+ */
+void print_finished_jobs(FILE* fp);
+
+#endif
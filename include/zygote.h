@@ -0,0 +1,38 @@
+#ifndef ZYGOTE_H
+#define ZYGOTE_H
+
+#include "icssh.h"
+#include "launcher.h"
+
+/*
+ * Setting this environment variable starts a warm Python zygote.
+ * The value is the interpreter command whose script runs are served by it
+ * (e.g. python3); 1 means python3.
+ */
+#define PYTHON_ZYGOTE_ENV "ICSSH_PYTHON_ZYGOTE"
+
+// Requests bigger than this are executed normally
+#define ZYGOTE_MAX_MSG (64 * 1024)
+
+/*
+ * Starts the zygote: a Python interpreter that has already imported what
+ * the usual scripts need and forks a ready child for each script run.
+ * Makes the shell a child subreaper so those children are reparented to it.
+ * Returns 0 on success, -1 on failure.
+ */
+int start_python_zygote(const char* interpreter);
+
+/*
+ * Returns true if proc is "<interpreter> script.py [args]" and the zygote is up.
+ */
+bool zygote_accepts(proc_info* proc);
+
+/*
+ * Runs proc's script in a child forked from the zygote, with rd wired to its
+ * stdin/stdout/stderr and its process group set exactly as the launcher would.
+ * The child ends up as a child of the shell and is waited for like any other.
+ * Returns the pid, or -1 with errno set to EAGAIN if proc has to be executed normally.
+ */
+pid_t zygote_launch(proc_info* proc, redir_t* rd, pid_t pgid);
+
+#endif
@@ -0,0 +1,135 @@
+#include "admission.h"
+#include "linkedlist.h"
+
+#include <string.h>
+
+#define QUEUED_ENTRY "%lu\tqueued %d (class %d)\t%s\n"
+
+typedef struct {
+    job_info* job;
+    int priority;       // class, 0 runs first
+    unsigned long seq;  // arrival order, keeps each class first come first served
+    time_t seconds;     // when the job was queued
+} queued_job_t;
+
+static list_t* queue = NULL;  // queued_job_t, in launch order
+static unsigned long next_seq = 0;
+
+
+static int compare_queued(const void* a, const void* b) {
+    const queued_job_t* q1 = a;
+    const queued_job_t* q2 = b;
+    if (q1->priority != q2->priority)
+        return q1->priority - q2->priority;
+    return q1->seq < q2->seq ? -1 : q1->seq > q2->seq;
+}
+
+void enable_admission_queue(void) {
+    if (queue == NULL) {
+        queue = CreateList(compare_queued, NULL, NULL);
+        KeepBackLinks(queue);
+    }
+}
+
+bool admission_queue_enabled(void) {
+    return queue != NULL;
+}
+
+void queue_bg_job(job_info* job) {
+    queued_job_t* entry = malloc(sizeof(queued_job_t));
+    entry->job = job;
+    entry->priority = ADMISSION_DEFAULT_CLASS;
+    entry->seq = next_seq++;
+    entry->seconds = time(NULL);
+    InsertInOrder(queue, entry);
+}
+
+job_info* dequeue_bg_job(void) {
+    queued_job_t* entry;
+    job_info* job;
+
+    if (queue == NULL || (entry = RemoveFromHead(queue)) == NULL)
+        return NULL;
+    job = entry->job;
+    free(entry);
+    return job;
+}
+
+int queued_bg_jobs(void) {
+    return queue != NULL ? queue->length : 0;
+}
+
+void print_admission_queue(FILE* fp) {
+    node_t* current;
+    int position = 1;
+
+    if (queue == NULL)
+        return;
+    for (current = queue->head; current != NULL; current = current->next, position++) {
+        queued_job_t* entry = current->data;
+        fprintf(fp, QUEUED_ENTRY, (unsigned long)entry->seconds, position,
+                entry->priority, entry->job->line);
+        fprintf(fp, "\n");
+    }
+}
+
+void clear_admission_queue(void) {
+    job_info* job;
+
+    while ((job = dequeue_bg_job()) != NULL)
+        free_job(job);
+}
+
+// Returns the node at a 1-based position given as text, or NULL
+static node_t* find_position(const char* arg) {
+    char* end;
+    long position = strtol(arg, &end, 10);
+    node_t* current;
+
+    if (queue == NULL || *end != '\0' || position < 1 || position > queue->length)
+        return NULL;
+    for (current = queue->head; --position > 0; current = current->next)
+        ;
+    return current;
+}
+
+void handle_bgcancel_command(job_info* job) {
+    proc_info* proc = job->procs;
+    node_t* node;
+
+    if (proc->argc == 1)
+        clear_admission_queue();
+    else if ((node = find_position(proc->argv[1])) == NULL)
+        fprintf(stderr, QUEUE_ERR);
+    else {
+        queued_job_t* entry = RemoveNode(queue, node);
+        free_job(entry->job);
+        free(entry);
+    }
+    free_job(job);
+}
+
+void handle_bgprio_command(job_info* job) {
+    proc_info* proc = job->procs;
+    node_t* node;
+    char* end;
+    long priority;
+
+    if (proc->argc != 3 || (node = find_position(proc->argv[1])) == NULL) {
+        fprintf(stderr, QUEUE_ERR);
+        free_job(job);
+        return;
+    }
+    priority = strtol(proc->argv[2], &end, 10);
+    if (*end != '\0' || end == proc->argv[2] || priority < 0 || priority >= ADMISSION_CLASSES) {
+        fprintf(stderr, CLASS_ERR);
+        free_job(job);
+        return;
+    }
+
+    // Re-inserted by class and original arrival, so it keeps its place among equals
+    queued_job_t* entry = RemoveNode(queue, node);
+    entry->priority = priority;
+    InsertInOrder(queue, entry);
+    free_job(job);
+}
@@ -0,0 +1,533 @@
+#include "builtins.h"
+#include "launcher.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+
+// Return values of read_escape that aren't characters
+#define ESC_STOP -1     // \c: produce no further output
+#define ESC_UNKNOWN -2  // not an escape, print the backslash as is
+
+/*
+ * Decodes the escape sequence following a backslash at s.
+ * zero_octal selects the echo/%b form \0NNN over the printf format form \NNN.
+ * Stores the character (or ESC_*) in ch and returns the number of bytes used.
+ */
+static int read_escape(const char* s, bool zero_octal, int* ch) {
+    int used = 1;
+    int value = 0;
+
+    switch (*s) {
+        case '\\': *ch = '\\'; return 1;
+        case 'a': *ch = '\a'; return 1;
+        case 'b': *ch = '\b'; return 1;
+        case 'c': *ch = ESC_STOP; return 1;
+        case 'e': *ch = 27; return 1;
+        case 'f': *ch = '\f'; return 1;
+        case 'n': *ch = '\n'; return 1;
+        case 'r': *ch = '\r'; return 1;
+        case 't': *ch = '\t'; return 1;
+        case 'v': *ch = '\v'; return 1;
+        case '"': *ch = '"'; return 1;
+        case 'x':
+            if (!isxdigit((unsigned char)s[1]))
+                break;
+            for (; used < 3 && isxdigit((unsigned char)s[used]); used++)
+                value = value * 16 + (isdigit((unsigned char)s[used]) ? s[used] - '0' : (tolower((unsigned char)s[used]) - 'a' + 10));
+            *ch = value;
+            return used;
+        default:
+            if (*s < '0' || *s > '7')
+                break;
+            if (zero_octal) {
+                if (*s != '0')
+                    break;
+                used = 1;
+                for (; used < 4 && s[used] >= '0' && s[used] <= '7'; used++)
+                    value = value * 8 + (s[used] - '0');
+            }
+            else {
+                used = 0;
+                for (; used < 3 && s[used] >= '0' && s[used] <= '7'; used++)
+                    value = value * 8 + (s[used] - '0');
+            }
+            *ch = value & 0xff;
+            return used;
+    }
+    *ch = ESC_UNKNOWN;
+    return 0;
+}
+
+// Prints s interpreting escapes; returns false if \c asked to stop all output
+static bool print_escaped(const char* s, bool zero_octal) {
+    int ch;
+    for (; *s; s++) {
+        if (*s != '\\' || s[1] == '\0') {
+            putchar(*s);
+            continue;
+        }
+        s += read_escape(s + 1, zero_octal, &ch);
+        if (ch == ESC_STOP)
+            return false;
+        if (ch == ESC_UNKNOWN)
+            putchar('\\');
+        else
+            putchar(ch);
+    }
+    return true;
+}
+
+
+/*
+ * echo [-neE] [string...], the coreutils flavour: options are only
+ * recognised if every letter is one of n, e, E.
+ */
+static int builtin_echo(int argc, char** argv) {
+    bool newline = true;
+    bool escapes = false;
+    int i;
+
+    for (i = 1; i < argc && argv[i][0] == '-' && argv[i][1] != '\0'; i++) {
+        char* p;
+        for (p = argv[i] + 1; *p == 'n' || *p == 'e' || *p == 'E'; p++)
+            ;
+        if (*p != '\0')
+            break;
+        for (p = argv[i] + 1; *p; p++) {
+            if (*p == 'n')
+                newline = false;
+            else
+                escapes = (*p == 'e');
+        }
+    }
+
+    for (; i < argc; i++) {
+        if (escapes) {
+            if (!print_escaped(argv[i], true))
+                return 0;
+        }
+        else
+            fputs(argv[i], stdout);
+        if (i + 1 < argc)
+            putchar(' ');
+    }
+    if (newline)
+        putchar('\n');
+    return 0;
+}
+
+
+static int builtin_pwd(int argc, char** argv) {
+    char* cwd = getcwd(NULL, 0);
+    if (cwd == NULL) {
+        perror("pwd");
+        return 1;
+    }
+    printf("%s\n", cwd);
+    free(cwd);
+    return 0;
+}
+
+
+// Numeric printf argument; 'c and "c give the character code
+static long long printf_number(const char* arg, int* status) {
+    char* end;
+    long long value;
+
+    if (arg == NULL || *arg == '\0')
+        return 0;
+    if (arg[0] == '\'' || arg[0] == '"')
+        return (unsigned char)arg[1];
+    errno = 0;
+    value = strtoll(arg, &end, 0);
+    if (*end != '\0' || errno != 0) {
+        fprintf(stderr, "printf: '%s': expected a numeric value\n", arg);
+        *status = 1;
+    }
+    return value;
+}
+
+static double printf_double(const char* arg, int* status) {
+    char* end;
+    double value;
+
+    if (arg == NULL || *arg == '\0')
+        return 0;
+    if (arg[0] == '\'' || arg[0] == '"')
+        return (unsigned char)arg[1];
+    value = strtod(arg, &end);
+    if (*end != '\0') {
+        fprintf(stderr, "printf: '%s': expected a numeric value\n", arg);
+        *status = 1;
+    }
+    return value;
+}
+
+// Longest conversion specification printf accepts, "ll", conversion and NUL included
+#define PRINTF_SPEC_MAX 64
+
+// Appends n bytes of s to the specification, if they fit with room left for "ll", the conversion and the NUL
+static bool spec_append(char* spec, int* len, const char* s, int n) {
+    if (*len + n > PRINTF_SPEC_MAX - 4)
+        return false;
+    memcpy(spec + *len, s, n);
+    *len += n;
+    return true;
+}
+
+/*
+ * printf format [argument...]. The format is reused while arguments remain.
+ */
+static int builtin_printf(int argc, char** argv) {
+    char** args = argv + 2;
+    int nargs = argc - 2;
+    int used = 0;
+    int status = 0;
+    char* p;
+
+    if (argc < 2) {
+        fprintf(stderr, "printf: missing operand\n");
+        return 1;
+    }
+
+    do {
+        int start = used;
+        for (p = argv[1]; *p; p++) {
+            char spec[PRINTF_SPEC_MAX];
+            char star[12];
+            bool fits = true;
+            int len = 0;
+            char* arg;
+            int ch;
+
+            if (*p == '\\' && p[1] != '\0') {
+                p += read_escape(p + 1, false, &ch);
+                if (ch == ESC_STOP)
+                    return status;
+                putchar(ch == ESC_UNKNOWN ? '\\' : ch);
+                continue;
+            }
+            if (*p != '%') {
+                putchar(*p);
+                continue;
+            }
+            if (p[1] == '%') {
+                putchar('%');
+                p++;
+                continue;
+            }
+
+            // Copy flags, width and precision; '*' takes its value from the arguments
+            spec[len++] = *p++;
+            for (; *p && strchr("-+ #0", *p); p++)
+                fits &= spec_append(spec, &len, p, 1);
+            if (*p == '*') {
+                snprintf(star, sizeof(star), "%d", (int)printf_number(used < nargs ? args[used++] : NULL, &status));
+                fits &= spec_append(spec, &len, star, strlen(star));
+                p++;
+            }
+            for (; isdigit((unsigned char)*p); p++)
+                fits &= spec_append(spec, &len, p, 1);
+            if (*p == '.') {
+                fits &= spec_append(spec, &len, p++, 1);
+                if (*p == '*') {
+                    snprintf(star, sizeof(star), "%d", (int)printf_number(used < nargs ? args[used++] : NULL, &status));
+                    fits &= spec_append(spec, &len, star, strlen(star));
+                    p++;
+                }
+                for (; isdigit((unsigned char)*p); p++)
+                    fits &= spec_append(spec, &len, p, 1);
+            }
+            if (!fits) {
+                fprintf(stderr, "printf: conversion specification too long\n");
+                return 1;
+            }
+
+            arg = used < nargs ? args[used++] : NULL;
+            switch (*p) {
+                case 's':
+                case 'c':
+                    if (*p == 'c' && (arg == NULL || *arg == '\0'))
+                        break;
+                    spec[len++] = 's';
+                    spec[len] = '\0';
+                    if (*p == 'c') {
+                        char one[2] = { arg[0], '\0' };
+                        printf(spec, one);
+                    }
+                    else
+                        printf(spec, arg ? arg : "");
+                    break;
+                case 'b':
+                    if (arg != NULL && !print_escaped(arg, true))
+                        return status;
+                    break;
+                case 'd':
+                case 'i':
+                    strcpy(spec + len, "lld");
+                    printf(spec, printf_number(arg, &status));
+                    break;
+                case 'o':
+                case 'u':
+                case 'x':
+                case 'X':
+                    snprintf(spec + len, 4, "ll%c", *p);
+                    printf(spec, (unsigned long long)printf_number(arg, &status));
+                    break;
+                case 'f':
+                case 'F':
+                case 'e':
+                case 'E':
+                case 'g':
+                case 'G':
+                case 'a':
+                case 'A':
+                    spec[len++] = *p;
+                    spec[len] = '\0';
+                    printf(spec, printf_double(arg, &status));
+                    break;
+                default:
+                    fprintf(stderr, "printf: %%%c: invalid conversion specification\n", *p ? *p : ' ');
+                    return 1;
+            }
+        }
+        // Stop once a pass over the format consumed nothing
+        if (used == start)
+            break;
+    } while (used < nargs);
+
+    return status;
+}
+
+
+/*
+ * test expression / [ expression ]
+ * Recursive descent over:  or := and {-o and};  and := not {-a not};
+ * not := ! not | primary;  primary := ( or ) | unary arg | arg binary arg | arg
+ */
+typedef struct {
+    char** argv;
+    int pos;
+    int end;
+    bool error;
+} test_state_t;
+
+static bool test_or(test_state_t* t);
+
+static bool is_binary_op(const char* s) {
+    static const char* ops[] = { "=", "==", "!=", "<", ">", "-eq", "-ne", "-lt", "-le", "-gt", "-ge",
+                                 "-nt", "-ot", "-ef", NULL };
+    int i;
+    for (i = 0; ops[i]; i++)
+        if (strcmp(s, ops[i]) == 0)
+            return true;
+    return false;
+}
+
+static bool is_unary_op(const char* s) {
+    return s[0] == '-' && s[1] != '\0' && s[2] == '\0' && strchr("bcdefghknprsStuwxzLO", s[1]) != NULL;
+}
+
+static long long test_integer(test_state_t* t, const char* s) {
+    char* end;
+    long long value;
+
+    errno = 0;
+    value = strtoll(s, &end, 10);
+    while (isspace((unsigned char)*end))
+        end++;
+    if (*s == '\0' || *end != '\0' || errno != 0) {
+        fprintf(stderr, "test: %s: integer expression expected\n", s);
+        t->error = true;
+    }
+    return value;
+}
+
+static bool test_unary(char op, const char* arg) {
+    struct stat st;
+
+    switch (op) {
+        case 'n': return *arg != '\0';
+        case 'z': return *arg == '\0';
+        case 't': return isatty(atoi(arg));
+        case 'h':
+        case 'L': return lstat(arg, &st) == 0 && S_ISLNK(st.st_mode);
+        case 'r': return access(arg, R_OK) == 0;
+        case 'w': return access(arg, W_OK) == 0;
+        case 'x': return access(arg, X_OK) == 0;
+    }
+    if (stat(arg, &st) != 0)
+        return false;
+    switch (op) {
+        case 'b': return S_ISBLK(st.st_mode);
+        case 'c': return S_ISCHR(st.st_mode);
+        case 'd': return S_ISDIR(st.st_mode);
+        case 'e': return true;
+        case 'f': return S_ISREG(st.st_mode);
+        case 'g': return (st.st_mode & S_ISGID) != 0;
+        case 'k': return (st.st_mode & S_ISVTX) != 0;
+        case 'p': return S_ISFIFO(st.st_mode);
+        case 's': return st.st_size > 0;
+        case 'S': return S_ISSOCK(st.st_mode);
+        case 'u': return (st.st_mode & S_ISUID) != 0;
+        case 'O': return st.st_uid == geteuid();
+        case 'G': return st.st_gid == getegid();
+    }
+    return false;
+}
+
+static bool test_binary(test_state_t* t, const char* a, const char* op, const char* b) {
+    struct stat sa, sb;
+
+    if (strcmp(op, "=") == 0 || strcmp(op, "==") == 0)
+        return strcmp(a, b) == 0;
+    if (strcmp(op, "!=") == 0)
+        return strcmp(a, b) != 0;
+    if (strcmp(op, "<") == 0)
+        return strcmp(a, b) < 0;
+    if (strcmp(op, ">") == 0)
+        return strcmp(a, b) > 0;
+    if (strcmp(op, "-nt") == 0 || strcmp(op, "-ot") == 0 || strcmp(op, "-ef") == 0) {
+        bool ha = stat(a, &sa) == 0, hb = stat(b, &sb) == 0;
+        if (op[1] == 'e')
+            return ha && hb && sa.st_dev == sb.st_dev && sa.st_ino == sb.st_ino;
+        if (op[1] == 'n')
+            return ha && (!hb || sa.st_mtim.tv_sec > sb.st_mtim.tv_sec ||
+                          (sa.st_mtim.tv_sec == sb.st_mtim.tv_sec && sa.st_mtim.tv_nsec > sb.st_mtim.tv_nsec));
+        return hb && (!ha || sa.st_mtim.tv_sec < sb.st_mtim.tv_sec ||
+                      (sa.st_mtim.tv_sec == sb.st_mtim.tv_sec && sa.st_mtim.tv_nsec < sb.st_mtim.tv_nsec));
+    }
+
+    long long x = test_integer(t, a), y = test_integer(t, b);
+    if (strcmp(op, "-eq") == 0) return x == y;
+    if (strcmp(op, "-ne") == 0) return x != y;
+    if (strcmp(op, "-lt") == 0) return x < y;
+    if (strcmp(op, "-le") == 0) return x <= y;
+    if (strcmp(op, "-gt") == 0) return x > y;
+    return x >= y;
+}
+
+static bool test_primary(test_state_t* t) {
+    char** argv = t->argv;
+    int left = t->end - t->pos;
+
+    if (left <= 0) {
+        fprintf(stderr, "test: argument expected\n");
+        t->error = true;
+        return false;
+    }
+    // Binary operators win, so "test ! = x" and "test -n = -n" compare strings
+    if (left >= 3 && is_binary_op(argv[t->pos + 1])) {
+        t->pos += 3;
+        return test_binary(t, argv[t->pos - 3], argv[t->pos - 2], argv[t->pos - 1]);
+    }
+    if (strcmp(argv[t->pos], "(") == 0 && left >= 2) {
+        bool value;
+        t->pos++;
+        value = test_or(t);
+        if (t->pos >= t->end || strcmp(argv[t->pos], ")") != 0) {
+            fprintf(stderr, "test: ')' expected\n");
+            t->error = true;
+            return false;
+        }
+        t->pos++;
+        return value;
+    }
+    if (left >= 2 && is_unary_op(argv[t->pos])) {
+        t->pos += 2;
+        return test_unary(argv[t->pos - 2][1], argv[t->pos - 1]);
+    }
+    // A lone string is true if it's not empty
+    return argv[t->pos++][0] != '\0';
+}
+
+static bool test_not(test_state_t* t) {
+    if (t->pos < t->end - 1 && strcmp(t->argv[t->pos], "!") == 0) {
+        t->pos++;
+        return !test_not(t);
+    }
+    return test_primary(t);
+}
+
+static bool test_and(test_state_t* t) {
+    bool value = test_not(t);
+    while (t->pos < t->end && strcmp(t->argv[t->pos], "-a") == 0) {
+        t->pos++;
+        value = test_not(t) && value;
+    }
+    return value;
+}
+
+static bool test_or(test_state_t* t) {
+    bool value = test_and(t);
+    while (t->pos < t->end && strcmp(t->argv[t->pos], "-o") == 0) {
+        t->pos++;
+        value = test_and(t) || value;
+    }
+    return value;
+}
+
+static int builtin_test(int argc, char** argv) {
+    test_state_t t = { argv, 1, argc, false };
+    bool value;
+
+    if (strcmp(argv[0], "[") == 0) {
+        if (strcmp(argv[argc - 1], "]") != 0) {
+            fprintf(stderr, "[: missing ']'\n");
+            return 2;
+        }
+        t.end--;
+    }
+    if (t.pos == t.end)
+        return 1;  // no expression is false
+
+    value = test_or(&t);
+    if (!t.error && t.pos != t.end) {
+        fprintf(stderr, "test: %s: unexpected argument\n", argv[t.pos]);
+        t.error = true;
+    }
+    if (t.error)
+        return 2;
+    return value ? 0 : 1;
+}
+
+
+bool is_simple_builtin(char* cmd) {
+    return strcmp(cmd, "echo") == 0 || strcmp(cmd, "true") == 0 || strcmp(cmd, "false") == 0 ||
+           strcmp(cmd, "printf") == 0 || strcmp(cmd, "test") == 0 || strcmp(cmd, "[") == 0 ||
+           strcmp(cmd, "pwd") == 0;
+}
+
+static int dispatch_simple_builtin(int argc, char** argv) {
+    if (strcmp(argv[0], "echo") == 0)
+        return builtin_echo(argc, argv);
+    if (strcmp(argv[0], "true") == 0)
+        return 0;
+    if (strcmp(argv[0], "false") == 0)
+        return 1;
+    if (strcmp(argv[0], "printf") == 0)
+        return builtin_printf(argc, argv);
+    if (strcmp(argv[0], "pwd") == 0)
+        return builtin_pwd(argc, argv);
+    return builtin_test(argc, argv);
+}
+
+int run_simple_builtin(job_info* job) {
+    proc_info* proc = job->procs;
+    int saved[3];
+    int status;
+
+    // Point our own stdio at the redirection files for the duration of the builtin
+    if (redirect_shell(job, saved) < 0)
+        return EXIT_FAILURE;
+
+    status = dispatch_simple_builtin(proc->argc, proc->argv);
+
+    // Flush even without redirection, children write to the same descriptors
+    fflush(stdout);
+    fflush(stderr);
+    restore_shell(saved);
+    return status;
+}
@@ -0,0 +1,284 @@
+#include "cmdlist.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Same wording as the parser library
+#define LIST_PARSE_ERR "Parse error: Invalid token near %s\n"
+
+typedef enum {
+	TOK_TEXT,    // a run of job text
+	TOK_SEMI,
+	TOK_AMP,
+	TOK_AND,
+	TOK_OR,
+	TOK_OPEN,
+	TOK_CLOSE,
+	TOK_END,
+} tok_kind_t;
+
+typedef struct {
+	const char* p;     // scan position in the line
+	tok_kind_t kind;   // current token
+	char* text;        // its text, for TOK_TEXT
+	const char* at;    // where it starts, for error messages
+	size_t len;        // and how long it is
+	bool separated;    // some operator other than a job's own trailing & was seen
+	bool error;
+} lexer_t;
+
+
+/*
+ * Is the & at s an operator? &> and >& are redirections of the job itself.
+ */
+static bool is_amp_operator(const char* line, const char* s) {
+	return s[1] != '>' && !(s > line && s[-1] == '>');
+}
+
+static void next_token(lexer_t* lx, const char* line) {
+	const char* start;
+	char quote = 0;
+
+	while (isspace((unsigned char)*lx->p))
+		lx->p++;
+	lx->at = lx->p;
+	free(lx->text);
+	lx->text = NULL;
+
+	lx->len = 1;
+	switch (*lx->p) {
+		case '\0': lx->kind = TOK_END; lx->len = 0; return;
+		case ';': lx->kind = TOK_SEMI; lx->p++; return;
+		case '(': lx->kind = TOK_OPEN; lx->p++; return;
+		case ')': lx->kind = TOK_CLOSE; lx->p++; return;
+		case '&':
+			if (lx->p[1] == '&') {
+				lx->kind = TOK_AND;
+				lx->len = 2;
+				lx->p += 2;
+				return;
+			}
+			if (is_amp_operator(line, lx->p)) {
+				lx->kind = TOK_AMP;
+				lx->p++;
+				return;
+			}
+			break;
+		case '|':
+			if (lx->p[1] == '|') {
+				lx->kind = TOK_OR;
+				lx->len = 2;
+				lx->p += 2;
+				return;
+			}
+			break;
+	}
+
+	// Job text runs up to the next operator outside quotes
+	start = lx->p;
+	for (; *lx->p; lx->p++) {
+		char c = *lx->p;
+		if (quote) {
+			if (c == quote)
+				quote = 0;
+			else if (c == '\\' && quote == '"' && lx->p[1])
+				lx->p++;
+			continue;
+		}
+		if (c == '\'' || c == '"')
+			quote = c;
+		else if (c == '\\' && lx->p[1])
+			lx->p++;
+		else if (c == ';' || c == '(' || c == ')' ||
+		         (c == '|' && lx->p[1] == '|') ||
+		         (c == '&' && (lx->p[1] == '&' || is_amp_operator(line, lx->p))))
+			break;
+	}
+	lx->kind = TOK_TEXT;
+	lx->len = lx->p - start;
+	lx->text = strndup(start, lx->p - start);
+	// Trailing blanks belong to no one
+	for (size_t n = strlen(lx->text); n > 0 && isspace((unsigned char)lx->text[n - 1]); n--)
+		lx->text[n - 1] = '\0';
+}
+
+static cmd_list_t* new_node(cmd_kind_t kind, cmd_list_t* left, cmd_list_t* right) {
+	cmd_list_t* node = calloc(1, sizeof(cmd_list_t));
+	node->kind = kind;
+	node->left = left;
+	node->right = right;
+	return node;
+}
+
+static void syntax_error(lexer_t* lx) {
+	if (!lx->error) {
+		char* token = lx->len > 0 ? strndup(lx->at, lx->len) : strdup("newline");
+		fprintf(stderr, LIST_PARSE_ERR, token);
+		free(token);
+	}
+	lx->error = true;
+}
+
+static cmd_list_t* parse_list(lexer_t* lx, const char* line);
+
+// Does job text start with a redirection, like "> file" or "2> err"?
+static bool is_redirection(const char* text) {
+	if (text[0] == '2' || text[0] == '&')
+		text++;
+	return text[0] == '<' || text[0] == '>';
+}
+
+// term := '(' list ')' [redirections] | job text
+static cmd_list_t* parse_term(lexer_t* lx, const char* line) {
+	cmd_list_t* node;
+
+	if (lx->kind == TOK_OPEN) {
+		lx->separated = true;
+		next_token(lx, line);
+		node = parse_list(lx, line);
+		if (node == NULL || lx->kind != TOK_CLOSE) {
+			syntax_error(lx);
+			free_command_list(node);
+			return NULL;
+		}
+		next_token(lx, line);
+		if (lx->kind == TOK_TEXT && is_redirection(lx->text)) {
+			node = new_node(CMD_GROUP, node, NULL);
+			node->text = lx->text;
+			lx->text = NULL;
+			next_token(lx, line);
+		}
+		return node;
+	}
+	if (lx->kind != TOK_TEXT) {
+		syntax_error(lx);
+		return NULL;
+	}
+	node = new_node(CMD_JOB, NULL, NULL);
+	node->text = lx->text;
+	lx->text = NULL;
+	next_token(lx, line);
+	return node;
+}
+
+// and_or := term (('&&' | '||') term)*
+static cmd_list_t* parse_and_or(lexer_t* lx, const char* line) {
+	cmd_list_t* node = parse_term(lx, line);
+
+	while (node != NULL && (lx->kind == TOK_AND || lx->kind == TOK_OR)) {
+		cmd_kind_t kind = lx->kind == TOK_AND ? CMD_AND : CMD_OR;
+		cmd_list_t* right;
+		lx->separated = true;
+		next_token(lx, line);
+		if ((right = parse_term(lx, line)) == NULL) {
+			free_command_list(node);
+			return NULL;
+		}
+		node = new_node(kind, node, right);
+	}
+	return node;
+}
+
+// list := and_or ((';' | '&') and_or)* [';' | '&']
+static cmd_list_t* parse_list(lexer_t* lx, const char* line) {
+	cmd_list_t* node = NULL;
+
+	for (;;) {
+		cmd_list_t* item = parse_and_or(lx, line);
+		if (item == NULL) {
+			free_command_list(node);
+			return NULL;
+		}
+		if (lx->kind == TOK_AMP) {
+			// Only a single job can be put in the background
+			if (item->kind != CMD_JOB) {
+				syntax_error(lx);
+				free_command_list(item);
+				free_command_list(node);
+				return NULL;
+			}
+			item->text = realloc(item->text, strlen(item->text) + 3);
+			strcat(item->text, " &");
+		}
+		node = node == NULL ? item : new_node(CMD_SEQ, node, item);
+
+		if (lx->kind != TOK_SEMI && lx->kind != TOK_AMP)
+			return node;
+		if (lx->kind == TOK_SEMI)
+			lx->separated = true;
+		next_token(lx, line);
+		if (lx->kind == TOK_END || lx->kind == TOK_CLOSE)
+			return node;
+		lx->separated = true;
+	}
+}
+
+cmd_list_t* parse_command_list(const char* line, bool* error) {
+	lexer_t lx = { line, TOK_END, NULL, line, 0, false, false };
+	cmd_list_t* list;
+
+	*error = false;
+	next_token(&lx, line);
+	if (lx.kind == TOK_END) {
+		free(lx.text);
+		return NULL;
+	}
+	list = parse_list(&lx, line);
+	if (list != NULL && lx.kind != TOK_END)
+		syntax_error(&lx);
+	free(lx.text);
+	if (lx.error) {
+		free_command_list(list);
+		*error = true;
+		return NULL;
+	}
+
+	// A lone job, backgrounded or not, is left to the usual path
+	if (!lx.separated) {
+		free_command_list(list);
+		return NULL;
+	}
+	return list;
+}
+
+bool run_command_list(cmd_list_t* list, bool (*run_job)(char* text), bool (*redirect)(char* text, int* saved),
+                      void (*restore)(int* saved), int* status) {
+	bool keep_going;
+	int saved[3];
+
+	switch (list->kind) {
+		case CMD_JOB:
+			return run_job(list->text);
+		case CMD_SEQ:
+			return run_command_list(list->left, run_job, redirect, restore, status) &&
+			       run_command_list(list->right, run_job, redirect, restore, status);
+		case CMD_AND:
+			if (!run_command_list(list->left, run_job, redirect, restore, status))
+				return false;
+			return *status != 0 || run_command_list(list->right, run_job, redirect, restore, status);
+		case CMD_OR:
+			if (!run_command_list(list->left, run_job, redirect, restore, status))
+				return false;
+			return *status == 0 || run_command_list(list->right, run_job, redirect, restore, status);
+		case CMD_GROUP:
+			if (!redirect(list->text, saved)) {
+				*status = 1;
+				return true;
+			}
+			keep_going = run_command_list(list->left, run_job, redirect, restore, status);
+			restore(saved);
+			return keep_going;
+	}
+	return true;
+}
+
+void free_command_list(cmd_list_t* list) {
+	if (list == NULL)
+		return;
+	free_command_list(list->left);
+	free_command_list(list->right);
+	free(list->text);
+	free(list);
+}
@@ -0,0 +1,432 @@
+#define _GNU_SOURCE
+#include "dag.h"
+#include "helpers.h"
+#include "launcher.h"
+#include "linereader.h"
+#include "events.h"
+#include "probes.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <time.h>
+
+#define DAG_USAGE "dag: usage: dag [-j jobs] file\n"
+#define DAG_FILE_ERR "dag: %s:%d: %s\n"
+
+typedef enum {
+    NODE_PENDING,
+    NODE_RUNNING,
+    NODE_DONE,
+    NODE_FAILED,
+    NODE_SKIPPED,
+} node_state_t;
+
+typedef struct {
+    char* name;
+    char** recipe;       // commands, run one after the other
+    int nrecipe;
+    char** dep_names;    // as written, resolved into deps once the file is read
+    int* deps;
+    int ndeps;
+    node_state_t state;
+    int step;            // recipe command running or next to run
+    pid_t* pids;         // of the running command, -1 once reaped
+    int npids;
+    int nlive;
+    int status;          // of the last stage of the running command
+    double started;
+    double elapsed;
+    double path;         // longest chain of elapsed times ending here
+    int via;             // dependency that chain goes through, -1 if none
+} dag_node_t;
+
+typedef struct {
+    dag_node_t* nodes;
+    int nnodes;
+    int* order;          // nodes in dependency order
+    int max_running;
+} dag_t;
+
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int find_node(dag_t* dag, const char* name) {
+    int i;
+    for (i = 0; i < dag->nnodes; i++)
+        if (strcmp(dag->nodes[i].name, name) == 0)
+            return i;
+    return -1;
+}
+
+static void free_dag(dag_t* dag) {
+    int i, k;
+
+    for (i = 0; i < dag->nnodes; i++) {
+        dag_node_t* node = &dag->nodes[i];
+        free(node->name);
+        for (k = 0; k < node->nrecipe; k++)
+            free(node->recipe[k]);
+        free(node->recipe);
+        for (k = 0; k < node->ndeps; k++)
+            free(node->dep_names[k]);
+        free(node->dep_names);
+        free(node->deps);
+        free(node->pids);
+    }
+    free(dag->nodes);
+    free(dag->order);
+}
+
+// Adds the node declared by "name: deps"; returns false if the line is malformed
+static bool add_node(dag_t* dag, char* line, int* cap, const char* file, int lineno) {
+    char* colon = strchr(line, ':');
+    char* name;
+    char* dep;
+    char* save;
+    dag_node_t* node;
+
+    if (colon == NULL) {
+        fprintf(stderr, DAG_FILE_ERR, file, lineno, "expected name: dependencies");
+        return false;
+    }
+    *colon = '\0';
+    name = strtok_r(line, " \t", &save);
+    if (name == NULL || strtok_r(NULL, " \t", &save) != NULL) {
+        fprintf(stderr, DAG_FILE_ERR, file, lineno, "expected a single node name");
+        return false;
+    }
+    if (find_node(dag, name) >= 0) {
+        fprintf(stderr, DAG_FILE_ERR, file, lineno, "node defined twice");
+        return false;
+    }
+
+    if (dag->nnodes == *cap) {
+        *cap *= 2;
+        dag->nodes = realloc(dag->nodes, *cap * sizeof(dag_node_t));
+    }
+    node = &dag->nodes[dag->nnodes++];
+    memset(node, 0, sizeof(dag_node_t));
+    node->name = strdup(name);
+    node->via = -1;
+    for (dep = strtok_r(colon + 1, " \t", &save); dep != NULL; dep = strtok_r(NULL, " \t", &save)) {
+        node->dep_names = realloc(node->dep_names, (node->ndeps + 1) * sizeof(char*));
+        node->dep_names[node->ndeps++] = strdup(dep);
+    }
+    return true;
+}
+
+// Reads the file into dag; reports what is wrong with it and returns false
+static bool read_dag(dag_t* dag, const char* file) {
+    line_reader_t* reader;
+    int cap = 16;
+    int lineno = 0;
+    bool ok = true;
+    char* line;
+    int fd;
+
+    if ((fd = open(file, O_RDONLY | O_CLOEXEC)) < 0) {
+        perror(file);
+        return false;
+    }
+    dag->nodes = malloc(cap * sizeof(dag_node_t));
+    reader = fd_line_reader(fd);
+    while (ok && (line = read_line(reader)) != NULL) {
+        char* p = line;
+        lineno++;
+        while (isspace((unsigned char)*p))
+            p++;
+        if (*p == '\0' || *p == '#')
+            continue;
+
+        if (p == line)
+            ok = add_node(dag, line, &cap, file, lineno);
+        else if (dag->nnodes == 0) {
+            fprintf(stderr, DAG_FILE_ERR, file, lineno, "command outside of a node");
+            ok = false;
+        }
+        else {
+            dag_node_t* node = &dag->nodes[dag->nnodes - 1];
+            node->recipe = realloc(node->recipe, (node->nrecipe + 1) * sizeof(char*));
+            node->recipe[node->nrecipe++] = strdup(p);
+        }
+    }
+    free_line_reader(reader);
+    close(fd);
+    return ok;
+}
+
+/*
+ * Resolves dependency names and puts the nodes in dependency order (Kahn's
+ * algorithm). Reports an unknown dependency or a cycle and returns false.
+ */
+static bool order_dag(dag_t* dag, const char* file) {
+    int* waiting = calloc(dag->nnodes, sizeof(int));
+    int head = 0, tail = 0;
+    int i, k;
+
+    for (i = 0; i < dag->nnodes; i++) {
+        dag_node_t* node = &dag->nodes[i];
+        node->deps = malloc((node->ndeps > 0 ? node->ndeps : 1) * sizeof(int));
+        for (k = 0; k < node->ndeps; k++) {
+            if ((node->deps[k] = find_node(dag, node->dep_names[k])) < 0) {
+                fprintf(stderr, "dag: %s: %s depends on unknown node %s\n", file, node->name, node->dep_names[k]);
+                free(waiting);
+                return false;
+            }
+        }
+        waiting[i] = node->ndeps;
+    }
+
+    dag->order = malloc((dag->nnodes > 0 ? dag->nnodes : 1) * sizeof(int));
+    for (i = 0; i < dag->nnodes; i++)
+        if (waiting[i] == 0)
+            dag->order[tail++] = i;
+    // Each node is released once everything it depends on is ordered
+    for (; head < tail; head++) {
+        for (i = 0; i < dag->nnodes; i++)
+            for (k = 0; k < dag->nodes[i].ndeps; k++)
+                if (dag->nodes[i].deps[k] == dag->order[head] && --waiting[i] == 0)
+                    dag->order[tail++] = i;
+    }
+    if (tail < dag->nnodes) {
+        for (i = 0; waiting[i] == 0; i++)
+            ;
+        fprintf(stderr, "dag: %s: dependency cycle through %s\n", file, dag->nodes[i].name);
+        free(waiting);
+        return false;
+    }
+    free(waiting);
+    return true;
+}
+
+// Ends a node; on failure everything downstream is skipped by next_ready
+static void finish_node(dag_node_t* node, node_state_t state) {
+    node->state = state;
+    node->elapsed = now() - node->started;
+    free(node->pids);
+    node->pids = NULL;
+    node->npids = node->nlive = 0;
+}
+
+/*
+ * Starts the node's current recipe command. Commands that can't be parsed or
+ * executed fail the node right away.
+ */
+static void start_step(dag_node_t* node) {
+    job_info* job = validate_input(node->recipe[node->step]);
+    int i;
+
+    if (job == NULL) {
+        node->status = 2;
+        finish_node(node, NODE_FAILED);
+        return;
+    }
+    job->bg = false;  // the node itself is what runs alongside others
+    node->npids = job->nproc;
+    node->pids = realloc(node->pids, job->nproc * sizeof(pid_t));
+
+    if (job->nproc == 1)
+        node->pids[0] = launch_job(job);
+    else if (launch_pipeline(job, node->pids) < 0) {
+        node->pids[0] = -1;
+        node->npids = 1;
+    }
+
+    node->nlive = 0;
+    for (i = 0; i < node->npids; i++)
+        if (node->pids[i] > 0)
+            node->nlive++;
+    // What a child that couldn't be executed exits with
+    node->status = node->pids[node->npids - 1] > 0 ? 0 : EXIT_FAILURE;
+    free_job(job);
+
+    if (node->nlive == 0)
+        finish_node(node, NODE_FAILED);
+}
+
+// Moves a node on after its running command finished
+static void step_done(dag_node_t* node) {
+    if (node->status != 0)
+        finish_node(node, NODE_FAILED);
+    else if (++node->step == node->nrecipe)
+        finish_node(node, NODE_DONE);
+    else
+        start_step(node);
+}
+
+/*
+ * Returns the next node whose dependencies all succeeded, or -1.
+ * Pending nodes behind a failure are marked skipped on the way.
+ */
+static int next_ready(dag_t* dag) {
+    int i, k;
+
+    for (i = 0; i < dag->nnodes; i++) {
+        dag_node_t* node = &dag->nodes[dag->order[i]];
+        bool ready = true;
+        if (node->state != NODE_PENDING)
+            continue;
+        for (k = 0; k < node->ndeps; k++) {
+            node_state_t dep = dag->nodes[node->deps[k]].state;
+            if (dep == NODE_FAILED || dep == NODE_SKIPPED) {
+                node->state = NODE_SKIPPED;
+                break;
+            }
+            if (dep != NODE_DONE)
+                ready = false;
+        }
+        if (node->state == NODE_PENDING && ready)
+            return dag->order[i];
+    }
+    return -1;
+}
+
+static void run_dag(dag_t* dag, job_table_t* bg_job_list, int* last_child_status) {
+    int running = 0;
+    struct rusage usage;
+    int status;
+    pid_t pid;
+    int next;
+    int i, k;
+
+    fflush(stdout);
+    if (wait_hook != NULL)
+        wait_hook();
+
+    for (;;) {
+        while (running < dag->max_running && (next = next_ready(dag)) >= 0) {
+            dag_node_t* node = &dag->nodes[next];
+            node->state = NODE_RUNNING;
+            node->started = now();
+            if (node->nrecipe == 0)
+                finish_node(node, NODE_DONE);
+            else {
+                start_step(node);
+                if (node->state == NODE_RUNNING)
+                    running++;
+            }
+        }
+        if (running == 0)
+            break;
+
+        if ((pid = wait_child(&status, &usage)) < 0) {
+            printf(WAIT_ERR);
+            exit(EXIT_FAILURE);
+        }
+        for (i = 0; i < dag->nnodes; i++) {
+            dag_node_t* node = &dag->nodes[i];
+            if (node->state != NODE_RUNNING)
+                continue;
+            for (k = 0; k < node->npids && node->pids[k] != pid; k++)
+                ;
+            if (k < node->npids)
+                break;
+        }
+        if (i == dag->nnodes) {
+            // Not ours: a background job of the shell
+            reap_child(bg_job_list, pid, status, &usage, last_child_status);
+            continue;
+        }
+
+        dag_node_t* node = &dag->nodes[i];
+        usage_add(&fg_usage, &usage);
+        PROBE3(child_reaped, pid, status, (long)((now() - node->started) * 1e6));
+        node->pids[k] = -1;
+        if (k == node->npids - 1)
+            node->status = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+        if (--node->nlive == 0) {
+            step_done(node);
+            if (node->state != NODE_RUNNING)
+                running--;
+        }
+    }
+}
+
+// Prints every node's result, then the longest chain of node times
+static void report_dag(dag_t* dag, double wall) {
+    dag_node_t* node;
+    int end = -1;
+    int i, k;
+
+    for (i = 0; i < dag->nnodes; i++) {
+        node = &dag->nodes[dag->order[i]];
+        if (node->state == NODE_SKIPPED) {
+            fprintf(stderr, "%s\tskipped\n", node->name);
+            continue;
+        }
+        node->path = node->elapsed;
+        for (k = 0; k < node->ndeps; k++) {
+            dag_node_t* dep = &dag->nodes[node->deps[k]];
+            if (dep->path + node->elapsed > node->path) {
+                node->path = dep->path + node->elapsed;
+                node->via = node->deps[k];
+            }
+        }
+        if (end < 0 || node->path > dag->nodes[end].path)
+            end = dag->order[i];
+
+        if (node->state == NODE_DONE)
+            fprintf(stderr, "%s\tok\t%.3fs\n", node->name, node->elapsed);
+        else
+            fprintf(stderr, "%s\tfailed (%d)\t%.3fs\n", node->name, node->status, node->elapsed);
+    }
+    if (end < 0)
+        return;
+
+    // Walk the chain back from its end, then print it from the start
+    int* chain = malloc(dag->nnodes * sizeof(int));
+    int len = 0;
+    for (i = end; i >= 0; i = dag->nodes[i].via)
+        chain[len++] = i;
+    fprintf(stderr, "critical path %.3fs:", dag->nodes[end].path);
+    while (len > 0)
+        fprintf(stderr, " %s", dag->nodes[chain[--len]].name);
+    fprintf(stderr, "\nwall %.3fs\n", wall);
+    free(chain);
+}
+
+void handle_dag_command(job_info* job, job_table_t* bg_job_list, int* last_child_status) {
+    proc_info* proc = job->procs;
+    dag_t dag = { 0 };
+    char* file;
+    double started;
+    int i;
+
+    dag.max_running = sysconf(_SC_NPROCESSORS_ONLN);
+    for (i = 1; i < proc->argc && proc->argv[i][0] == '-'; i++) {
+        if (strcmp(proc->argv[i], "-j") == 0 && i + 1 < proc->argc)
+            dag.max_running = atoi(proc->argv[++i]);
+        else
+            break;
+    }
+    if (i != proc->argc - 1 || dag.max_running < 1) {
+        fprintf(stderr, DAG_USAGE);
+        *last_child_status = 2;
+        free_job(job);
+        return;
+    }
+    file = proc->argv[i];
+
+    if (!read_dag(&dag, file) || !order_dag(&dag, file)) {
+        *last_child_status = 2;
+        free_dag(&dag);
+        free_job(job);
+        return;
+    }
+
+    started = now();
+    run_dag(&dag, bg_job_list, last_child_status);
+    report_dag(&dag, now() - started);
+
+    *last_child_status = 0;
+    for (i = 0; i < dag.nnodes; i++)
+        if (dag.nodes[i].state != NODE_DONE)
+            *last_child_status = 1;
+
+    free_dag(&dag);
+    free_job(job);
+}
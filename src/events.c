@@ -0,0 +1,166 @@
+#include "events.h"
+#include "linkedlist.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <stdint.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+struct shell_timer {
+    struct timespec deadline;
+    void (*fn)(void*);
+    void* arg;
+    node_t* node;  // in the timer list
+};
+
+static int sigchld_fd = -1;
+static sigset_t original_mask;
+static bool children_missed = false;  // SIGCHLDs drained by wait_child
+
+static int timer_fd = -1;
+static list_t* timers = NULL;  // shell_timer_t, earliest deadline first
+
+
+int init_child_events(void) {
+    sigset_t mask;
+
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    if (sigprocmask(SIG_BLOCK, &mask, &original_mask) < 0)
+        return -1;
+    if ((sigchld_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC)) < 0) {
+        sigprocmask(SIG_SETMASK, &original_mask, NULL);
+        return -1;
+    }
+    return 0;
+}
+
+int child_events_fd(void) {
+    return sigchld_fd;
+}
+
+bool drain_child_events(void) {
+    struct signalfd_siginfo info[16];
+    bool pending = children_missed;
+    ssize_t n;
+
+    // Several exits may be folded into one signal; the caller reaps them all
+    while ((n = read(sigchld_fd, info, sizeof(info))) > 0 || (n < 0 && errno == EINTR))
+        if (n > 0)
+            pending = true;
+    children_missed = false;
+    return pending;
+}
+
+const sigset_t* child_sigmask(void) {
+    return &original_mask;
+}
+
+
+static int compare_timers(const void* a, const void* b) {
+    const struct timespec* x = &((const shell_timer_t*)a)->deadline;
+    const struct timespec* y = &((const shell_timer_t*)b)->deadline;
+    if (x->tv_sec != y->tv_sec)
+        return x->tv_sec < y->tv_sec ? -1 : 1;
+    return (x->tv_nsec > y->tv_nsec) - (x->tv_nsec < y->tv_nsec);
+}
+
+// Points the timerfd at the earliest deadline, or disarms it
+static void arm_timer_fd(void) {
+    struct itimerspec its = { 0 };
+
+    if (timers->head != NULL)
+        its.it_value = ((shell_timer_t*)timers->head->data)->deadline;
+    timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+shell_timer_t* add_timer(long ms, void (*fn)(void*), void* arg) {
+    shell_timer_t* timer;
+
+    if (timers == NULL) {
+        if ((timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)) < 0)
+            return NULL;
+        timers = CreateList(compare_timers, NULL, NULL);
+        KeepBackLinks(timers);
+    }
+
+    timer = malloc(sizeof(shell_timer_t));
+    clock_gettime(CLOCK_MONOTONIC, &timer->deadline);
+    timer->deadline.tv_sec += ms / 1000;
+    timer->deadline.tv_nsec += (ms % 1000) * 1000000;
+    if (timer->deadline.tv_nsec >= 1000000000) {
+        timer->deadline.tv_sec++;
+        timer->deadline.tv_nsec -= 1000000000;
+    }
+    timer->fn = fn;
+    timer->arg = arg;
+    timer->node = InsertInOrder(timers, timer);
+    if (timers->head == timer->node)
+        arm_timer_fd();
+    return timer;
+}
+
+void cancel_timer(shell_timer_t* timer) {
+    bool first = timers->head == timer->node;
+
+    RemoveNode(timers, timer->node);
+    free(timer);
+    if (first)
+        arm_timer_fd();
+}
+
+int timer_events_fd(void) {
+    return timer_fd;
+}
+
+void run_due_timers(void) {
+    uint64_t expirations;
+    struct timespec now;
+
+    if (timers == NULL)
+        return;
+    while (read(timer_fd, &expirations, sizeof(expirations)) < 0 && errno == EINTR)
+        ;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    while (timers->head != NULL) {
+        shell_timer_t* timer = timers->head->data;
+        if (timer->deadline.tv_sec > now.tv_sec ||
+            (timer->deadline.tv_sec == now.tv_sec && timer->deadline.tv_nsec > now.tv_nsec))
+            break;
+        // Off the list first: the callback may add timers or cancel others
+        RemoveFromHead(timers);
+        timer->fn(timer->arg);
+        free(timer);
+    }
+    arm_timer_fd();
+}
+
+pid_t wait_child(int* status, struct rusage* usage) {
+    struct pollfd fds[2] = {
+        { sigchld_fd, POLLIN, 0 },
+        { timer_fd, POLLIN, 0 },
+    };
+    pid_t pid;
+
+    for (;;) {
+        if ((pid = wait4(-1, status, WNOHANG, usage)) != 0)
+            return pid;
+        // Without timers there is nothing to do but wait
+        if (timers == NULL || timers->length == 0) {
+            while ((pid = wait4(-1, status, 0, usage)) < 0 && errno == EINTR)
+                ;
+            return pid;
+        }
+        if (poll(fds, 2, -1) < 0 && errno != EINTR)
+            return -1;
+        if (fds[1].revents & POLLIN)
+            run_due_timers();
+        if ((fds[0].revents & POLLIN) && drain_child_events())
+            children_missed = true;
+    }
+}
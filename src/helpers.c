@@ -1,6 +1,22 @@
 #include "linkedlist.h"
 #include "icssh.h"
+#include "helpers.h"
+#include "launcher.h"
+#include "pathcache.h"
+#include "jobtable.h"
+#include "pool.h"
+#include "admission.h"
+#include "events.h"
+#include "throttle.h"
+#include "timeout.h"
+#include "trace.h"
+#include "shstat.h"
+#include "probes.h"
 #include <string.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+
+static pool_t bgentry_pool = POOL_INITIALIZER("background jobs", bgentry_t);
 
 // Your helper functions need to be here.
 int is_builtin_command(char* line){
@@ -14,27 +30,51 @@ int is_builtin_command(char* line){
             return 1;
         else if (strcmp(line, "fg") == 0)
             return 1;
+        else if (strcmp(line, "hash") == 0)
+            return 1;
+        else if (strcmp(line, "exec") == 0)
+            return 1;
+        else if (strcmp(line, "bgcancel") == 0)
+            return 1;
+        else if (strcmp(line, "bgprio") == 0)
+            return 1;
+        else if (strcmp(line, "parallel") == 0)
+            return 1;
+        else if (strcmp(line, "pmap") == 0)
+            return 1;
+        else if (strcmp(line, "dag") == 0)
+            return 1;
+        else if (strcmp(line, "throttle") == 0)
+            return 1;
+        else if (strcmp(line, "trace") == 0)
+            return 1;
+        else if (strcmp(line, "shstat") == 0)
+            return 1;
         else 
             return 0;
 }
 
 
 
-int handle_exit_command(job_info* job, list_t* bg_job_list){
+int handle_exit_command(job_info* job, job_table_t* bg_job_list){
             // Terminate all background jobs before exiting
-            node_t* current = bg_job_list->head;
+            node_t* current = bg_job_list->jobs->head;
             while (current != NULL) {
                 bgentry_t* bg_entry = (bgentry_t*)current->data;
                 printf(BG_TERM, bg_entry->pid, bg_entry->job->line);  
-                kill(bg_entry->pid, SIGTERM); 
-                free_job(bg_entry->job);
-                free(bg_entry);
+                // The whole process group, so every stage of a pipeline goes
+                if (kill(-bg_entry->pid, SIGTERM) < 0)
+                    kill(bg_entry->pid, SIGTERM);
+                // A job the throttler stopped only sees the SIGTERM once it runs again
+                if (kill(-bg_entry->pid, SIGCONT) < 0)
+                    kill(bg_entry->pid, SIGCONT);
+                free_bgentry(bg_entry);
                 current = current->next;
             }
 
-            // Clean up and exit
-            DeleteList(bg_job_list);
-            free(bg_job_list);
+            // Clean up and exit; queued jobs never started, so they just go
+            clear_admission_queue();
+            free_job_table(bg_job_list);
             free_job(job);
             validate_input(NULL);   // calling validate_input with NULL will free the memory it has allocated
             return 0;
@@ -73,6 +113,7 @@ void handle_cd_command(job_info* job){
 					}
 				}
 			}
+			path_cache_cwd_changed();  // relative PATH entries now point elsewhere
 			free_job(job);
 }
 
@@ -83,9 +124,31 @@ void handle_estatus_command(job_info* job, int last_child_status){
 			free_job(job);
 }
 
-void handle_bglist_command(job_info* job, list_t* bg_job_list){
+void handle_exec_command(job_info* job, int* last_child_status){
+            // exec without a command only redirects the shell itself
+			if (job->procs->argc == 1) {
+				if (redirect_shell(job, NULL) < 0)
+					*last_child_status = EXIT_FAILURE;
+			}
+			else {
+				// Drop "exec" and become the rest of the command line
+				shift_words(job->procs, 1);
+				if (exec_job(job) < 0)
+					*last_child_status = EXIT_FAILURE;
+			}
+			free_job(job);
+}
+
+void handle_bglist_command(job_info* job, job_table_t* bg_job_list){
 
-            PrintLinkedList(bg_job_list, stderr);
+            // -t: elapsed and CPU time of running jobs, then of recently finished ones
+            if (job->procs->argc > 1 && strcmp(job->procs->argv[1], "-t") == 0) {
+                print_job_table_usage(bg_job_list, stderr);
+                print_finished_jobs(stderr);
+            }
+            else
+                print_job_table(bg_job_list, stderr);
+            print_admission_queue(stderr);
 			free_job(job);
 }
 
@@ -97,343 +160,289 @@ int compare_bgentry(const void* a, const void* b) {
     return (bg2->seconds - bg1->seconds);  // Most recent first
 }
 
-// Helper function to find a background job by PID 
-bgentry_t* find_bg_job_by_pid(list_t* bg_job_list, pid_t pid) {
-    node_t* current = bg_job_list->head;
-    while (current != NULL) {
-        bgentry_t* entry = (bgentry_t*)current->data;
-        if (entry->pid == pid) {
-            return entry;
-        }
-        current = current->next;
+// Helper function to find a background job by the PID of any of its processes
+bgentry_t* find_bg_job_by_pid(job_table_t* bg_job_list, pid_t pid) {
+    return job_table_find(bg_job_list, pid);
+}
+
+void free_bgentry(bgentry_t* entry) {
+    stop_job_timeout(entry->timeout);
+    free_job(entry->job);
+    free(entry->pids);
+    pool_free(&bgentry_pool, entry);
+}
+
+
+void (*job_removed_hook)(void) = NULL;
+
+void remove_process_from_list(job_table_t* bg_job_list, bgentry_t* entry) {
+    job_table_remove(bg_job_list, entry);
+    free_bgentry(entry);
+    // A slot is free now
+    if (job_removed_hook != NULL)
+        job_removed_hook();
+}
+
+
+void reap_child(job_table_t* bg_job_list, pid_t pid, int status, const struct rusage* usage, int* last_child_status) {
+    uint64_t start = TRACE_START();
+    bgentry_t* entry = find_bg_job_by_pid(bg_job_list, pid);
+    int i;
+    if (entry == NULL)  // not one of our background jobs
+        return;
+
+    for (i = 0; i < entry->npids && entry->pids[i] != pid; i++)
+        ;
+    if (i < entry->npids) {
+        PROBE3(child_reaped, pid, status, (long)(usage_elapsed(&entry->usage) * 1e6));
+        entry->pids[i] = -1;
+        entry->nlive--;
+        usage_add(&entry->usage, usage);
+        job_table_forget_pid(bg_job_list, entry, pid);
+        // Like in the foreground, the job's status is its last command's
+        if (i == entry->npids - 1)
+            entry->status = status;
+    }
+    // A pipeline is done only once every stage is
+    if (entry->nlive > 0) {
+        TRACE_SPAN("reap", start, pid);
+        return;
     }
-    return NULL; 
+
+    printf(BG_TERM, entry->pid, entry->job->line);
+    shell_stats.bg_reaped++;
+    usage_end(&entry->usage);
+    record_finished_job(entry->job->line, entry->pid, entry->seconds, entry->status,
+                        job_timed_out(entry->timeout), &entry->usage);
+    if (job_timed_out(entry->timeout))
+        *last_child_status = TIMEOUT_STATUS;
+    else if (WIFEXITED(entry->status))
+        *last_child_status = WEXITSTATUS(entry->status);  // Update status if exited normally
+    remove_process_from_list(bg_job_list, entry);
+    TRACE_SPAN("reap", start, pid);
 }
 
+void reap_terminated_children(job_table_t* bg_job_list, int* child_terminated, int* last_child_status) {
+    struct rusage usage;
+    int status;
+    pid_t pid;
+    // Reap each terminated child one at a time
+    while ((pid = wait4(-1, &status, WNOHANG, &usage)) > 0)
+        reap_child(bg_job_list, pid, status, &usage, last_child_status);
+
+    // Reset the flag after all terminated children have been reaped
+    *child_terminated = 0;
+}
 
-void remove_process_from_list(list_t* bg_job_list, pid_t pid) {
-    node_t* current = bg_job_list->head;
-    int index = 0;
-    while (current != NULL) {
-        bgentry_t* entry = (bgentry_t*)current->data;
-        if (entry->pid == pid) {
-            RemoveByIndex(bg_job_list, index);
-            free_job(entry->job);
-            free(entry);
+void copy_file_to(int src_fd, int dest_fd) {
+    char buf[64 * 1024];
+    struct stat st;
+    off_t offset = 0;
+    ssize_t n;
+
+    if (fstat(src_fd, &st) < 0)
+        return;
+    // sendfile refuses some destinations, O_APPEND files among them
+    while (offset < st.st_size && sendfile(dest_fd, src_fd, &offset, st.st_size - offset) > 0)
+        ;
+    while (offset < st.st_size && (n = pread(src_fd, buf, sizeof(buf), offset)) > 0) {
+        ssize_t done = 0, w;
+        while (done < n && (w = write(dest_fd, buf + done, n - done)) > 0)
+            done += w;
+        if (done < n)
             break;
-        }
-        current = current->next;
-        index++;
+        offset += n;
     }
 }
 
+void (*wait_hook)(void) = NULL;
 
-void reap_terminated_children(list_t* bg_job_list, int* child_terminated, int* last_child_status) {
+void wait_for_processes(job_table_t* bg_job_list, pid_t* pids, int n, int* statuses, job_usage_t* usage,
+                        int* last_child_status) {
+    uint64_t start = TRACE_START();
+    uint64_t waited = stat_clock();
+    struct rusage ru;
+    int remaining = 0;
     int status;
     pid_t pid;
-    // Reap each terminated child one at a time
-    while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
-        bgentry_t* entry = find_bg_job_by_pid(bg_job_list,pid);
-        printf(BG_TERM, pid, entry->job->line);
-        remove_process_from_list(bg_job_list, pid);
-
-        if (WIFEXITED(status)) 
-            *last_child_status = WEXITSTATUS(status);  // Update status if exited normally
-        
+    int i;
+
+    // Let the shell get work done while the children run
+    if (wait_hook != NULL)
+        wait_hook();
+
+    for (i = 0; i < n; i++)
+        if (pids[i] > 0)
+            remaining++;
+
+    // One wait loop for the whole set; background jobs finishing meanwhile are reaped too
+    while (remaining > 0) {
+        if ((pid = wait_child(&status, &ru)) < 0) {
+            printf(WAIT_ERR);
+            exit(EXIT_FAILURE);
+        }
+        for (i = 0; i < n && pids[i] != pid; i++)
+            ;
+        if (i < n) {
+            PROBE3(child_reaped, pid, status, (long)((stat_clock() - waited) / 1000));
+            // Gone, so a timeout firing later can't signal a reused pid
+            pids[i] = -1;
+            statuses[i] = status;
+            usage_add(usage, &ru);
+            remaining--;
+        }
+        else
+            reap_child(bg_job_list, pid, status, &ru, last_child_status);
     }
-    // Reset the flag after all terminated children have been reaped
-    *child_terminated = 0;
+    stat_latency(shell_stats.wait_us, waited);
+    TRACE_SPAN("wait", start, n);
 }
 
 
 
-void handle_fg_command(job_info* job, list_t* bg_job_list) {
-            pid_t pid;
+// Waits for every process of bg still running, then drops it from the list
+static void wait_for_bg_job(bgentry_t* bg, job_table_t* bg_job_list, int* last_child_status) {
+    int* statuses = malloc(bg->npids * sizeof(int));
+
+    printf("%s\n", bg->job->line);
+    // Out of the table while in the foreground, so the throttler leaves it alone
+    job_table_remove(bg_job_list, bg);
+    unthrottle_job(bg);
+    // The last process may have been reaped already, or never started
+    statuses[bg->npids - 1] = bg->status;
+    wait_for_processes(bg_job_list, bg->pids, bg->npids, statuses, &bg->usage, last_child_status);
+    bg->status = statuses[bg->npids - 1];
+    usage_end(&bg->usage);
+    shell_stats.bg_reaped++;
+    record_finished_job(bg->job->line, bg->pid, bg->seconds, bg->status, job_timed_out(bg->timeout), &bg->usage);
+    if (job_timed_out(bg->timeout))
+        *last_child_status = TIMEOUT_STATUS;
+    else if (WIFEXITED(bg->status))
+        *last_child_status = WEXITSTATUS(bg->status);
+    free(statuses);
+    free_bgentry(bg);
+    if (job_removed_hook != NULL)
+        job_removed_hook();
+}
+
+void handle_fg_command(job_info* job, job_table_t* bg_job_list, int* last_child_status) {
          // bring the most recent bg process
-            if (bg_job_list->length == 0){
+            if (bg_job_list->jobs->length == 0){
                 fprintf(stderr, PID_ERR);
             }
 			else if (job->procs->argc == 1) {
-                int status;
-                bgentry_t* bg = bg_job_list->head->data;
+                bgentry_t* bg = bg_job_list->jobs->head->data;
                 if (bg == NULL){
                     fprintf(stderr, PID_ERR);
                 }
                 else {
-                    pid_t bg_pid = bg->pid ;
-                    printf("%s\n", bg->job->line);
-    				if ((pid = waitpid(bg_pid, &status, 0)) < 0) {
-                        fprintf(stderr, PID_ERR);
-                    }
-                    remove_process_from_list(bg_job_list, bg_pid);
+                    wait_for_bg_job(bg, bg_job_list, last_child_status);
                 }
 			}
                 
             // bring the bg process with given PID
 			else {
-                int status;
                 pid_t bg_pid = atoi(job->procs->argv[1]);
                 bgentry_t* bg = find_bg_job_by_pid(bg_job_list, bg_pid);
                 if (bg == NULL){
                     fprintf(stderr, PID_ERR);
                 }
                 else {
-                    printf("%s\n", bg->job->line);
-    				if ((pid = waitpid(bg->pid, &status, 0)) < 0) {
-                        fprintf(stderr, PID_ERR);
-                    }
-                    remove_process_from_list(bg_job_list, bg->pid);
+                    wait_for_bg_job(bg, bg_job_list, last_child_status);
                 }
 			}
 			free_job(job);
 }
 
 
-void handle_bg_process(job_info* job, list_t* bg_job_list, pid_t pid) {
+void handle_bg_process(job_info* job, job_table_t* bg_job_list, pid_t* pids, int n) {
         // Create a new bgentry_t for the job
-        bgentry_t* new_bg = malloc(sizeof(bgentry_t));
+        bgentry_t* new_bg = pool_alloc(&bgentry_pool);
+        int i;
         new_bg->job = job;
-        new_bg->pid = pid;
+        new_bg->pid = -1;
         new_bg->seconds = time(NULL);
+        usage_start(&new_bg->usage);
+        new_bg->pids = malloc(n * sizeof(pid_t));
+        new_bg->npids = n;
+        new_bg->nlive = 0;
+        new_bg->status = EXIT_FAILURE << 8;  // a last command that never started
+        new_bg->throttled = false;
+        for (i = 0; i < n; i++) {
+            new_bg->pids[i] = pids[i];
+            if (pids[i] > 0) {
+                // The first process started leads the job's process group
+                if (new_bg->pid < 0)
+                    new_bg->pid = pids[i];
+                new_bg->nlive++;
+            }
+        }
 
-        // Insert into the background job list
-        InsertInOrder(bg_job_list, new_bg);
+        new_bg->timeout = start_job_timeout(new_bg->pids, n, new_bg->pid);
+
+        // Insert into the background job table
+        job_table_insert(bg_job_list, new_bg);
+        shell_stats.bg_launched++;
+        if (bg_job_list->jobs->length > shell_stats.bg_peak)
+            shell_stats.bg_peak = bg_job_list->jobs->length;
 }
 
-void handle_fg_process(job_info* job, list_t* bg_job_list, int* last_child_status, 	pid_t pid) {
+void handle_fg_process(job_info* job, job_table_t* bg_job_list, int* last_child_status, 	pid_t pid) {
+        job_timeout_t* timeout = start_job_timeout(&pid, 1, -1);
         int status;
-    	pid_t wait_result = waitpid(pid, &status, 0);
-    	if (wait_result < 0) {
-    		printf(WAIT_ERR);
-    		exit(EXIT_FAILURE);
-    		}
+        wait_for_processes(bg_job_list, &pid, 1, &status, &fg_usage, last_child_status);
             // Update last_child_status based on child's exit status
         *last_child_status = WEXITSTATUS(status);
+        if (stop_job_timeout(timeout))
+            *last_child_status = TIMEOUT_STATUS;
 }
 
-void execute_child_process(job_info* job){
-
-    // Check for redirection conflicts
-    if ((job->in_file && job->out_file && strcmp(job->in_file, job->out_file) == 0) ||
-        (job->in_file && job->procs->err_file && strcmp(job->in_file, job->procs->err_file) == 0) ||
-        (job->out_file && job->procs->err_file && strcmp(job->out_file, job->procs->err_file) == 0)) {
-        fprintf(stderr, RD_ERR);  // Same file shared for multiple types of redirection
-        free_job(job);  
-        validate_input(NULL);
-        exit(EXIT_FAILURE);
-    }
-    
-    int fd;
-        // Handle input redirection
-    if (job->in_file) {
-        fd = open(job->in_file, O_RDONLY, 0);
-        if (fd < 0) {
-            fprintf(stderr, RD_ERR);
-            exit(EXIT_FAILURE);
-        }
-        if (dup2(fd, STDIN_FILENO) < 0) {
-            perror("Error duplicating file descriptor for input");
-            close(fd);
-            exit(EXIT_FAILURE);
-        }
-        close(fd);
-    }
-
-    // Handle output redirection
-    if (job->out_file) {
-        fd = open(job->out_file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-        if (fd < 0) {
-            perror("Error opening output file");
-            exit(EXIT_FAILURE);
-        }
-        if (dup2(fd, STDOUT_FILENO) < 0) {
-            perror("Error duplicating file descriptor for output");
-            close(fd);
-            exit(EXIT_FAILURE);
-        }
-        close(fd);
-    }
-
-    // Handle error redirection
-    if (job->procs->err_file) {
-        fd = open(job->procs->err_file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-        if (fd < 0) {
-            perror("Error opening error file");
-            exit(EXIT_FAILURE);
-        }
-        if (dup2(fd, STDERR_FILENO) < 0) {
-            perror("Error duplicating file descriptor for error");
-            close(fd);
-            exit(EXIT_FAILURE);
-        }
-        close(fd);
-    }
+void shift_words(proc_info* proc, int count) {
+    int i;
 
-    
-    int exec_result;
-	proc_info* proc = job->procs;
-	exec_result = execvp(proc->cmd, proc->argv);
-	if (exec_result < 0) {  //Error checking
-		printf(EXEC_ERR, proc->cmd);
-				// Cleaning up to make Valgrind happy 
-				// (not necessary because child will exit. Resources will be reaped by parent)
-		free_job(job);  
-    	validate_input(NULL);  // calling validate_input with NULL will free the memory it has allocated
-
-		exit(EXIT_FAILURE);
-	}   
+    for (i = 0; i < count; i++)
+        free(proc->argv[i]);
+    memmove(proc->argv, proc->argv + count, (proc->argc - count + 1) * sizeof(char*));
+    proc->argc -= count;
+    proc->cmd = proc->argv[0];
 }
 
 
-// Function to execute jobs with a single pipe (two commands)
-void handle_single_pipe(job_info* job, int* last_child_status, list_t* bg_job_list) {
-    int p[2];
-    pid_t pid1, pid2;
-
-    if (pipe(p) == -1) {
-        perror("pipe");
-        exit(EXIT_FAILURE);
-    }
-
-    proc_info *proc1 = job->procs;
-    proc_info *proc2 = proc1->next_proc;
-
-    // First process in the pipeline
-    if ((pid1 = fork()) == 0) {
-        close(p[0]); 
-        dup2(p[1], STDOUT_FILENO); 
-        close(p[1]);
-
-        // Execute first command in the job
-        execvp(proc1->cmd, proc1->argv);
-        perror("execvp failed for first command");
-        exit(EXIT_FAILURE);
-    } else if (pid1 < 0) {
-        perror("fork failed for first command");
-        exit(EXIT_FAILURE);
-    }
+// Function to execute jobs with any number of piped processes
+void handle_pipeline(job_info* job, int* last_child_status, job_table_t* bg_job_list) {
+    pid_t* pids = malloc(job->nproc * sizeof(pid_t));
+    int* statuses = malloc(job->nproc * sizeof(int));
+    int i;
 
-    // Second process in the pipeline
-    if ((pid2 = fork()) == 0) {
-        close(p[1]); 
-        dup2(p[0], STDIN_FILENO); 
-        close(p[0]);
-
-        // Execute second command in the job
-        execvp(proc2->cmd, proc2->argv);
-        perror("execvp failed for second command");
-        exit(EXIT_FAILURE);
-    } else if (pid2 < 0) {
-        perror("fork failed for second command");
-        exit(EXIT_FAILURE);
+    if (launch_pipeline(job, pids) < 0) {
+        *last_child_status = EXIT_FAILURE;
+        free(pids);
+        free(statuses);
+        free_job(job);
+        return;
     }
 
-    // Parent process
-    close(p[0]);
-    close(p[1]);
-
-    int status1, status2;
     if (job->bg) {
-        // If it's a background job, add it to the list and return
-        waitpid(pid1, &status1, 0);
-        handle_bg_process(job, bg_job_list, pid2);
-        return; 
-    }
-
-    // Wait for both child processes to complete
-    waitpid(pid1, &status1, 0);
-    waitpid(pid2, last_child_status, 0); // Capture the last command status
-
-    free_job(job);
-}
-
-
-// Function to execute jobs with two pipes (three commands)
-void handle_two_pipes(job_info* job, int* last_child_status, list_t* bg_job_list) {
-    int p1[2], p2[2];
-    pid_t pid1, pid2, pid3;
-
-    // Create two pipes for the three commands
-    if (pipe(p1) == -1 || pipe(p2) == -1) {
-        perror("pipe");
-        exit(EXIT_FAILURE);
-    }
-
-    proc_info *proc1 = job->procs;
-    proc_info *proc2 = proc1->next_proc;
-    proc_info *proc3 = proc2->next_proc;
-
-    // First process in the pipeline
-    if ((pid1 = fork()) == 0) {
-        close(p1[0]); 
-        dup2(p1[1], STDOUT_FILENO); 
-        close(p1[1]);
-
-        // Execute first command in the job
-        execvp(proc1->cmd, proc1->argv);
-        perror("execvp failed for first command");
-        exit(EXIT_FAILURE);
-    } else if (pid1 < 0) {
-        perror("fork failed for first command");
-        exit(EXIT_FAILURE);
-    }
-
-    // Second process in the pipeline
-    if ((pid2 = fork()) == 0) {
-        close(p1[1]); 
-        dup2(p1[0], STDIN_FILENO); 
-        close(p1[0]);
-
-        close(p2[0]); 
-        dup2(p2[1], STDOUT_FILENO); 
-        close(p2[1]);
-
-        // Execute second command in the job
-        execvp(proc2->cmd, proc2->argv);
-        perror("execvp failed for second command");
-        exit(EXIT_FAILURE);
-    } else if (pid2 < 0) {
-        perror("fork failed for second command");
-        exit(EXIT_FAILURE);
-    }
-
-    // Third process in the pipeline
-    if ((pid3 = fork()) == 0) {
-        close(p1[0]); 
-        close(p1[1]);
-        close(p2[1]); 
-        dup2(p2[0], STDIN_FILENO); 
-        close(p2[0]);
-
-        // Execute third command in the job
-        execvp(proc3->cmd, proc3->argv);
-        perror("execvp failed for third command");
-        exit(EXIT_FAILURE);
-    } else if (pid3 < 0) {
-        perror("fork failed for third command");
-        exit(EXIT_FAILURE);
+        // Every stage is tracked; the prompt comes back right away
+        for (i = 0; i < job->nproc && pids[i] < 0; i++)
+            ;
+        if (i < job->nproc)
+            handle_bg_process(job, bg_job_list, pids, job->nproc);
+        else
+            free_job(job);
     }
-
-    // Parent process
-    close(p1[0]);
-    close(p1[1]);
-    close(p2[0]);
-    close(p2[1]);
-
-    int status1, status2, status3;
-    if (job->bg) {
-        // If it's a background job, add it to the list and return
-        waitpid(pid1, &status1, 0);
-        waitpid(pid2, &status2, 0);
-        handle_bg_process(job, bg_job_list, pid3);
-        return; 
+    else {
+        job_timeout_t* timeout = start_job_timeout(pids, job->nproc, -1);
+        // What a last command that never started would have exited with
+        statuses[job->nproc - 1] = EXIT_FAILURE << 8;
+        wait_for_processes(bg_job_list, pids, job->nproc, statuses, &fg_usage, last_child_status);
+        // The pipeline's status is the status of its last command
+        if (stop_job_timeout(timeout))
+            *last_child_status = TIMEOUT_STATUS;
+        else
+            *last_child_status = WEXITSTATUS(statuses[job->nproc - 1]);
+        free_job(job);
     }
-
-    // Wait for all child processes to complete
-    waitpid(pid1, &status1, 0);
-    waitpid(pid2, &status2, 0);
-    waitpid(pid3, last_child_status, 0); // Capture the last command status
-
-    free_job(job);
+    free(pids);
+    free(statuses);
 }
-
@@ -1,84 +1,153 @@
 #include "icssh.h"
 #include "linkedlist.h"
 #include "helpers.h"
+#include "launcher.h"
+#include "pathcache.h"
+#include "spawnserver.h"
+#include "zygote.h"
+#include "builtins.h"
+#include "linereader.h"
+#include "jobtable.h"
+#include "pool.h"
+#include "admission.h"
+#include "parallel.h"
+#include "pmap.h"
+#include "dag.h"
+#include "throttle.h"
+#include "timeout.h"
+#include "proclimits.h"
+#include "trace.h"
+#include "shstat.h"
+#include "probes.h"
+#include "cmdlist.h"
+#include "events.h"
 
+#include <errno.h>
+#include <poll.h>
 #include <readline/readline.h>
 
 int last_child_status = 0;
 int child_terminated = 0;
 
+static job_table_t* bg_job_list = NULL;
+static int max_bgprocs = -1;
+static line_reader_t* batch_input = NULL;  // NULL when reading through readline
 
-void sigchld_handler(int sig) {
-    // Signal handler for SIGCHLD, sets the flag to indicate a child has terminated
-    child_terminated = 1;
-}
+// Lines of batch input parsed while a foreground child ran, see parse_ahead()
+#define PARSE_AHEAD_MAX 32
 
-void sigusr2_handler(int sig) {
-    time_t now = time(NULL);    
-    char* date_str = ctime(&now);   
-    if (date_str != NULL) {
-        write(STDERR_FILENO, date_str, strlen(date_str));
-    }
-}
+typedef struct {
+	job_info* job;       // NULL if the line was empty or invalid
+	cmd_list_t* list;    // instead of job, for a line with ;, &&, || or ( )
+	char* errors;        // what validate_input printed to stderr, replayed in order
+} parsed_line_t;
 
+static parsed_line_t parse_queue[PARSE_AHEAD_MAX];
+static int pq_head = 0;
+static int pq_len = 0;
+static bool pq_barrier = false;  // the last queued line is a builtin; parse no further
 
-int main(int argc, char* argv[]) {
-    int max_bgprocs = -1;
-	int exec_result;
-	int exit_status;
-    list_t* bg_job_list = NULL;
-	pid_t pid;
-	pid_t wait_result;
-	char* line;
-#ifdef GS
-    rl_outstream = fopen("/dev/null", "w");
-#endif
+static bool shell_exiting = false;  // set by the readline line handler
+static uint64_t prompt_start = 0;  // when readline began waiting for a line, for tracing
+static bool in_command_list = false;  // more of the line may follow the current job
+static bool in_timed_job = false;  // time reports once the job is done, so it can't be exec'd
 
-    bg_job_list = CreateList(compare_bgentry, print_bgentry, free);
 
+/*
+ * Parses a line into a command list or, if it is a plain job, into *job.
+ * Returns false if the line is malformed; the error has been printed.
+ */
+static bool parse_line(char* line, job_info** job, cmd_list_t** list) {
+    uint64_t start = TRACE_START();
+    bool bad;
 
-    // check command line arg
-    if(argc > 1) {
-        int check = atoi(argv[1]);
-        if(check != 0)
-            max_bgprocs = check;
-        else {
-            printf("Invalid command line argument value\n");
-            exit(EXIT_FAILURE);
+    *job = NULL;
+    if ((*list = parse_command_list(line, &bad)) == NULL && !bad)
+        *job = validate_input(line);
+    if (*job != NULL)
+        PROBE2(command_parsed, (*job)->line, (*job)->nproc);
+    TRACE_SPAN("parse", start, *job != NULL ? (*job)->nproc : 0);
+    return !bad;
+}
+
+/*
+ * Runs while a foreground child of a batch run executes: reads and validates
+ * the lines that are already buffered, so that work is hidden behind the
+ * child. Parse errors are captured and printed when the line's turn comes.
+ * A builtin stops the read-ahead until it has run, since it may change
+ * what the following lines mean (validate_input even writes into the cwd).
+ * So does a command list, whose jobs are only parsed when they run.
+ */
+static void parse_ahead(void) {
+    while (pq_len < PARSE_AHEAD_MAX && !pq_barrier && line_reader_has_line(batch_input)) {
+        parsed_line_t* next = &parse_queue[(pq_head + pq_len) % PARSE_AHEAD_MAX];
+        char* line = read_line(batch_input);
+        FILE* real_stderr = stderr;
+        size_t size;
+
+        // A regular file may turn out to be at its end only now
+        if (line == NULL)
+            break;
+        stderr = open_memstream(&next->errors, &size);
+        parse_line(line, &next->job, &next->list);
+        if (next->list != NULL)
+            pq_barrier = true;
+        fclose(stderr);
+        stderr = real_stderr;
+        if (size == 0) {
+            free(next->errors);
+            next->errors = NULL;
         }
+
+        if (next->job != NULL && next->job->nproc == 1 && is_builtin_command(next->job->procs->cmd))
+            pq_barrier = true;
+        pq_len++;
     }
+}
 
-	// Setup segmentation fault handler
-	if (signal(SIGSEGV, sigsegv_handler) == SIG_ERR) {
-		perror("Failed to set signal handler");
-		exit(EXIT_FAILURE);
-	}
+/*
+ * Returns the next job of a batch run (NULL for an empty or invalid line)
+ * through *job, or the line's command list through *list.
+ * Returns false at end of input.
+ */
+static bool next_batch_job(job_info** job, cmd_list_t** list) {
+    uint64_t start;
+    char* line;
 
-    // Setup the SIGCHLD handler
-    if (signal(SIGCHLD, sigchld_handler) == SIG_ERR) {
-        perror("Failed to set SIGCHLD handler");
-        exit(EXIT_FAILURE);
-    }
-     // Setup the SIGUSR2 handler
-    if (signal(SIGUSR2, sigusr2_handler) == SIG_ERR) {
-        perror("Failed to set SIGUSR2 handler");
-        exit(EXIT_FAILURE);
+    if (pq_len > 0) {
+        parsed_line_t* next = &parse_queue[pq_head];
+        if (next->errors != NULL) {
+            fputs(next->errors, stderr);
+            free(next->errors);
+        }
+        *job = next->job;
+        *list = next->list;
+        pq_head = (pq_head + 1) % PARSE_AHEAD_MAX;
+        if (--pq_len == 0)
+            pq_barrier = false;
+        return true;
     }
 
-    	// print the prompt & wait for the user to enter commands string
-	while ((line = readline(SHELL_PROMPT)) != NULL) {
-        
-            // Check flag to reap all the terminated bg processes 
-            if (child_terminated)
-                reap_terminated_children(bg_job_list, &child_terminated, &last_child_status);
-        
-        	// MAGIC HAPPENS! Command string is parsed into a job struct
-        	// Will print out error message if command string is invalid
-		    job_info* job = validate_input(line);
-        	if (job == NULL) { // Command was empty string or invalid
-			free(line);
-			continue;
-		}
+    start = TRACE_START();
+    line = read_line(batch_input);
+    TRACE_SPAN("read_line", start, 0);
+    if (line == NULL)
+        return false;
+    parse_line(line, job, list);
+    return true;
+}
+
+static bool run_timed_job(job_info* job);
+
+/*
+ * Runs one parsed command line.
+ * Returns false if the shell has to exit.
+ */
+static bool run_job(job_info* job) {
+	pid_t pid;
+
+        	if (job == NULL) // Command was empty string or invalid
+			return true;
 
         	//Prints out the job linked list struture for debugging
         	#ifdef DEBUG   // If DEBUG flag removed in makefile, this will not longer print
@@ -87,28 +156,48 @@ int main(int argc, char* argv[]) {
 
 
         // Background process but maximum is reached
-        if (job->bg && bg_job_list->length >= max_bgprocs && max_bgprocs != -1) {
-            fprintf(stderr, BG_ERR);
-            free(line);
-            free_job(job);
-            continue;
+        if (job->bg && bg_job_list->jobs->length >= max_bgprocs && max_bgprocs != -1) {
+            if (admission_queue_enabled())
+                queue_bg_job(job);  // started by admit_queued_jobs() when a slot frees up
+            else {
+                fprintf(stderr, BG_ERR);
+                free_job(job);
+            }
+            return true;
         } 
 
-        // Check if it's a piped command with exactly 2 processes
-        if (job->nproc > 1) {
-           if (job->nproc == 2) 
-                handle_single_pipe(job, &last_child_status, bg_job_list);
-            else if (job->nproc == 3) 
-                handle_two_pipes(job, &last_child_status, bg_job_list);
-            free(line);
-        }
+        // time is a prefix too, around everything that runs the job
+        if (strcmp(job->procs->cmd, "time") == 0 && job->procs->argc > 1)
+            return run_timed_job(job);
+        shell_stats.commands++;
+
+        // timeout is a prefix: it sets the job's time limit and leaves the rest to run
+        if (!take_job_timeout(job, &last_child_status))
+            return true;
+        // and so is run, with the CPUs, niceness and memory the job's processes get
+        if (!take_job_limits(job, &last_child_status))
+            return true;
+
+        // pmap takes the whole pipeline after it as the command to copy
+        if (strcmp(job->procs->cmd, "pmap") == 0)
+            handle_pmap_command(job, bg_job_list, &last_child_status);
+
+        // Piped command, any number of processes
+        else if (job->nproc > 1)
+            handle_pipeline(job, &last_child_status, bg_job_list);
             
         
+        // echo, test and friends run inside the shell unless backgrounded
+        else if (!job->bg && is_simple_builtin(job->procs->cmd)) {
+            last_child_status = run_simple_builtin(job);
+            free_job(job);
+        }
+
         // built in command
         else if (is_builtin_command(job->procs->cmd)){
             if (strcmp(job->procs->cmd, "exit") == 0) {
-                free(line);
-                return handle_exit_command(job ,bg_job_list);
+                handle_exit_command(job ,bg_job_list);
+                return false;
             }
             else if (strcmp(job->procs->cmd, "cd") == 0)
                 handle_cd_command(job);
@@ -117,40 +206,353 @@ int main(int argc, char* argv[]) {
             else if (strcmp(job->procs->cmd, "bglist") == 0)
                 handle_bglist_command(job, bg_job_list);
             else if (strcmp(job->procs->cmd, "fg") == 0)
-                handle_fg_command(job, bg_job_list);
-            free(line);
+                handle_fg_command(job, bg_job_list, &last_child_status);
+            else if (strcmp(job->procs->cmd, "hash") == 0)
+                handle_hash_command(job);
+            else if (strcmp(job->procs->cmd, "exec") == 0)
+                handle_exec_command(job, &last_child_status);
+            else if (strcmp(job->procs->cmd, "bgcancel") == 0)
+                handle_bgcancel_command(job);
+            else if (strcmp(job->procs->cmd, "bgprio") == 0)
+                handle_bgprio_command(job);
+            else if (strcmp(job->procs->cmd, "parallel") == 0)
+                handle_parallel_command(job, bg_job_list, &last_child_status);
+            else if (strcmp(job->procs->cmd, "dag") == 0)
+                handle_dag_command(job, bg_job_list, &last_child_status);
+            else if (strcmp(job->procs->cmd, "throttle") == 0)
+                handle_throttle_command(job, bg_job_list);
+            else if (strcmp(job->procs->cmd, "trace") == 0)
+                handle_trace_command(job);
+            else if (strcmp(job->procs->cmd, "shstat") == 0)
+                handle_shstat_command(job);
         }
             
         // Not built in command
         else {
-            // create the child proccess
-    		if ((pid = fork()) < 0) {
-    			perror("fork error");
-    			exit(EXIT_FAILURE);
-    		}
-
-            // If zero, then it's the child process
-    		if (pid == 0) {  
-                execute_child_process(job);
-                free(line);
-    		}
-            // Its a parent process
-            else {  
-                if (job->bg)  // background process  
-                    handle_bg_process(job, bg_job_list, pid);
-
-                else  {     // foreground process     
-                    handle_fg_process(job, bg_job_list, &last_child_status, pid);
-                    free_job(job);
-                }
-                free(line);
-        	}
+            // Last command of a script with nothing left to wait for: become it
+            if (!job->bg && bg_job_list->jobs->length == 0 && batch_input != NULL && !in_command_list && !in_timed_job &&
+                job_timeout_ms == 0 && job_limits == NULL && pq_len == 0 && line_reader_exhausted(batch_input)) {
+                exec_job(job);  // only returns if the exec failed
+                last_child_status = EXIT_FAILURE;
+                free_job(job);
+            }
+            // spawn the child proccess without copying the shell
+            else if ((pid = launch_job(job)) < 0) {
+                last_child_status = EXIT_FAILURE;  // what the failed child used to exit with
+                free_job(job);
+            }
+            else if (job->bg)  // background process
+                handle_bg_process(job, bg_job_list, &pid, 1);
+
+            else  {     // foreground process
+                handle_fg_process(job, bg_job_list, &last_child_status, pid);
+                free_job(job);
+            }
         }
-        
-	}
+        return true;
+}
+
+/*
+ * time command: runs the job and reports what its processes used.
+ * In the background the figures go to bglist -t instead.
+ */
+static bool run_timed_job(job_info* job) {
+    bool keep_going;
+
+    shift_words(job->procs, 1);
+    if (job->bg)
+        return run_job(job);
+    usage_start(&fg_usage);
+    in_timed_job = true;
+    keep_going = run_job(job);
+    in_timed_job = false;
+    print_time_report(stderr, &fg_usage);
+    return keep_going;
+}
+
+/*
+ * Runs one job of a command list, parsed now that its turn has come.
+ */
+static bool run_list_job(char* text) {
+    uint64_t start = TRACE_START();
+    job_info* job = validate_input(text);
+
+    if (job != NULL)
+        PROBE2(command_parsed, job->line, job->nproc);
+    TRACE_SPAN("parse", start, job != NULL ? job->nproc : 0);
+    if (job == NULL)
+        last_child_status = 2;  // what a shell's syntax error gives, so && stops
+    return run_job(job);
+}
+
+/*
+ * Applies the redirections written after a group's ) to the shell itself,
+ * by parsing them as those of a job.
+ */
+static bool redirect_group(char* text, int* saved) {
+    char* line = malloc(strlen(text) + 6);
+    job_info* job;
+    int result;
+
+    sprintf(line, "true %s", text);
+    job = validate_input(line);
+    free(line);
+    if (job == NULL)
+        return false;
+    result = redirect_shell(job, saved);
+    free_job(job);
+    return result == 0;
+}
+
+static bool run_list(cmd_list_t* list) {
+    bool keep_going;
+
+    in_command_list = true;
+    keep_going = run_command_list(list, run_list_job, redirect_group, restore_shell, &last_child_status);
+    in_command_list = false;
+    free_command_list(list);
+    return keep_going;
+}
+
+/*
+ * Starts queued background jobs while there are free slots.
+ * Runs whenever a job is removed from the job table.
+ */
+static void admit_queued_jobs(void) {
+    job_info* job;
+
+    while (bg_job_list->jobs->length < max_bgprocs && (job = dequeue_bg_job()) != NULL)
+        run_job(job);
+}
+
+/*
+ * At the end of input, waits until every queued job has been started;
+ * a batch driver counts on them running.
+ */
+static void drain_admission_queue(void) {
+    struct rusage usage;
+    int status;
+    pid_t pid;
+
+    while (queued_bg_jobs() > 0 && (pid = wait_child(&status, &usage)) > 0)
+        reap_child(bg_job_list, pid, status, &usage, &last_child_status);
+}
+
+/*
+ * Reaps whatever SIGCHLD reported; signals arrive through the signalfd,
+ * so nothing can slip in between checking and blocking for input.
+ */
+static void reap_reported_children(void) {
+    if (drain_child_events()) {
+        child_terminated = 1;
+        reap_terminated_children(bg_job_list, &child_terminated, &last_child_status);
+    }
+}
+
+/*
+ * Readline calls this with each complete line (NULL at end of input).
+ */
+static void handle_line(char* line) {
+    bool keep_going = line != NULL;
+
+    TRACE_SPAN("readline", prompt_start, 0);
+    if (line != NULL) {
+        cmd_list_t* list;
+        job_info* job;
+        uint64_t start;
+
+        // MAGIC HAPPENS! Command string is parsed into a job struct
+        // Will print out error message if command string is invalid
+        if (parse_line(line, &job, &list)) {
+            start = TRACE_START();
+            keep_going = list != NULL ? run_list(list) : run_job(job);
+            TRACE_SPAN("run", start, 0);
+        }
+        free(line);
+        // Children that ended while a job was waited for, before the next prompt
+        if (keep_going)
+            reap_reported_children();
+    }
+    if (!keep_going) {
+        rl_callback_handler_remove();
+        shell_exiting = true;
+    }
+    prompt_start = TRACE_START();
+}
+
+/*
+ * The interactive loop: waits for keystrokes, child exits and timers together, so a
+ * background job is reported the moment it ends instead of at the next Enter.
+ */
+static void interactive_loop(void) {
+    struct pollfd fds[3] = {
+        { STDIN_FILENO, POLLIN, 0 },
+        { child_events_fd(), POLLIN, 0 },
+        { -1, POLLIN, 0 },
+    };
+
+    rl_callback_handler_install(SHELL_PROMPT, handle_line);
+    prompt_start = TRACE_START();
+    while (!shell_exiting) {
+        fds[2].fd = timer_events_fd();  // created with the first timer
+        if (poll(fds, 3, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("poll");
+            break;
+        }
+        if (fds[1].revents & POLLIN) {
+            // Print above the prompt, then put the prompt and the partial line back
+            rl_clear_visible_line();
+            reap_reported_children();
+            fflush(stdout);
+            rl_forced_update_display();
+        }
+        if (fds[2].revents & POLLIN)
+            run_due_timers();
+        if (fds[0].revents & (POLLIN | POLLHUP | POLLERR))
+            rl_callback_read_char();
+    }
+}
+
+static void usage_error(void) {
+    printf("Invalid command line argument value\n");
+    exit(EXIT_FAILURE);
+}
+
+static int parse_bg_limit(const char* arg) {
+    int check = atoi(arg);
+    if (check == 0)
+        usage_error();
+    return check;
+}
+
+static bool is_number(const char* s) {
+    if (*s == '-')
+        s++;
+    if (*s == '\0')
+        return false;
+    for (; *s; s++)
+        if (*s < '0' || *s > '9')
+            return false;
+    return true;
+}
+
+
+/*
+ * Usage: 53shell [-q] [-j max_bgprocs] [-c command | script] 
+ *        53shell max_bgprocs
+ * -q queues background jobs over the limit instead of rejecting them.
+ * Without -c or a script, commands come from stdin: through readline on a
+ * terminal, through the buffered line reader otherwise.
+ */
+int main(int argc, char* argv[]) {
+	char* command = NULL;
+	char* script = NULL;
+	int opt;
+#ifdef GS
+    rl_outstream = fopen("/dev/null", "w");
+#endif
+
+    // Fork the spawn server while the shell is still small
+    char* spawn_server = getenv(SPAWN_SERVER_ENV);
+    if (spawn_server != NULL && strcmp(spawn_server, "1") == 0 && start_spawn_server() < 0)
+        perror("Failed to start spawn server");
+
+    char* zygote = getenv(PYTHON_ZYGOTE_ENV);
+    if (zygote != NULL && *zygote != '\0' &&
+        start_python_zygote(strcmp(zygote, "1") == 0 ? "python3" : zygote) < 0)
+        perror("Failed to start python zygote");
+
+    char* trace_file = getenv(TRACE_ENV);
+    if (trace_file != NULL && *trace_file != '\0' && start_tracing(trace_file) < 0)
+        fprintf(stderr, "Tracing is not compiled in\n");
+
+    bg_job_list = create_job_table();
+
+
+    // check command line args; a lone number is the old max_bgprocs form
+    if (argc == 2 && is_number(argv[1]))
+        max_bgprocs = parse_bg_limit(argv[1]);
+    else {
+        while ((opt = getopt(argc, argv, "+c:j:q")) != -1) {
+            if (opt == 'c')
+                command = optarg;
+            else if (opt == 'j')
+                max_bgprocs = parse_bg_limit(optarg);
+            else if (opt == 'q')
+                enable_admission_queue();
+            else
+                usage_error();
+        }
+        if (optind < argc)
+            script = argv[optind];
+    }
+
+    if (command != NULL)
+        batch_input = string_line_reader(command);
+    else if (script != NULL) {
+        int fd = open(script, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            perror(script);
+            exit(EXIT_FAILURE);
+        }
+        batch_input = fd_line_reader(fd);
+    }
+    else if (!isatty(STDIN_FILENO))
+        batch_input = stdin_line_reader = fd_line_reader(STDIN_FILENO);
+
+    // Setup segmentation fault handler
+    if (signal(SIGSEGV, sigsegv_handler) == SIG_ERR) {
+        perror("Failed to set signal handler");
+        exit(EXIT_FAILURE);
+    }
+
+    // Child exits are read from a signalfd, see reap_reported_children()
+    if (init_child_events() < 0) {
+        perror("Failed to set up SIGCHLD handling");
+        exit(EXIT_FAILURE);
+    }
+    job_removed_hook = admit_queued_jobs;
+
+    // SIGUSR2 dumps the shell's counters to stderr, see shstat.h
+    if (signal(SIGUSR2, sigusr2_handler) == SIG_ERR) {
+        perror("Failed to set SIGUSR2 handler");
+        exit(EXIT_FAILURE);
+    }
+
+    // Batch input: parse ahead while children run
+    if (batch_input != NULL) {
+        bool keep_going = true;
+        cmd_list_t* list;
+        job_info* job;
+
+        wait_hook = parse_ahead;
+        while (keep_going && next_batch_job(&job, &list)) {
+            uint64_t start;
+
+            reap_reported_children();
+            run_due_timers();
+            start = TRACE_START();
+            keep_going = list != NULL ? run_list(list) : run_job(job);
+            TRACE_SPAN("run", start, 0);
+        }
+        if (keep_going)
+            drain_admission_queue();
+    }
+
+    // print the prompt & wait for the user to enter commands string
+    else
+        interactive_loop();
+
+#ifdef DEBUG
+	print_pool_stats(stderr);
+#endif
+    finish_tracing();
 
 #ifndef GS
-	fclose(rl_outstream);
+	if (rl_outstream != NULL)
+		fclose(rl_outstream);
 #endif
 	return 0;
 }
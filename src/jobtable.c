@@ -0,0 +1,159 @@
+#include "jobtable.h"
+#include "helpers.h"
+#include "probes.h"
+
+#include <stdint.h>
+
+#define SLOT_FREED ((pid_t)-1)
+#define THROTTLED_ENTRY "%lu\t%u\t%s\tthrottled\n"
+
+
+// The list's printer; print_bgentry always writes to stderr, whatever fp is
+static void print_bgentry_node(void* p, void* fp) {
+    (void)fp;
+    print_bgentry(p);
+}
+
+job_table_t* create_job_table(void) {
+    job_table_t* table = malloc(sizeof(job_table_t));
+    table->jobs = CreateList(compare_bgentry, print_bgentry_node, NULL);
+    KeepBackLinks(table->jobs);
+    table->capacity = JOB_TABLE_MIN_SLOTS;
+    table->slots = calloc(table->capacity, sizeof(job_slot_t));
+    table->used = 0;
+    return table;
+}
+
+// Fibonacci hashing; consecutive pids land far apart
+static size_t pid_hash(job_table_t* table, pid_t pid) {
+    return ((uint32_t)pid * 2654435769u) & (table->capacity - 1);
+}
+
+static job_slot_t* find_slot(job_table_t* table, pid_t pid) {
+    size_t i = pid_hash(table, pid);
+
+    while (table->slots[i].pid != 0) {
+        if (table->slots[i].pid == pid)
+            return &table->slots[i];
+        i = (i + 1) & (table->capacity - 1);
+    }
+    return NULL;
+}
+
+static void put_slot(job_table_t* table, pid_t pid, bgentry_t* entry) {
+    size_t i = pid_hash(table, pid);
+
+    while (table->slots[i].pid > 0)
+        i = (i + 1) & (table->capacity - 1);
+    if (table->slots[i].pid == 0)
+        table->used++;
+    table->slots[i].pid = pid;
+    table->slots[i].entry = entry;
+}
+
+// Rebuilds the index, sized for the live pids, once freed slots pile up
+static void rehash(job_table_t* table, size_t live) {
+    job_slot_t* old = table->slots;
+    size_t old_capacity = table->capacity;
+    size_t i;
+
+    table->capacity = JOB_TABLE_MIN_SLOTS;
+    while (table->capacity < live * 4)
+        table->capacity *= 2;
+    table->slots = calloc(table->capacity, sizeof(job_slot_t));
+    table->used = 0;
+    for (i = 0; i < old_capacity; i++)
+        if (old[i].pid > 0)
+            put_slot(table, old[i].pid, old[i].entry);
+    free(old);
+}
+
+void job_table_insert(job_table_t* table, bgentry_t* entry) {
+    size_t live = 0;
+    size_t i;
+    int k;
+
+    entry->node = InsertAtHead(table->jobs, entry);
+
+    // Keep at most 3/4 of the slots used, freed ones included
+    if ((table->used + entry->nlive) * 4 > table->capacity * 3) {
+        for (i = 0; i < table->capacity; i++)
+            if (table->slots[i].pid > 0)
+                live++;
+        rehash(table, live + entry->nlive);
+    }
+    for (k = 0; k < entry->npids; k++)
+        if (entry->pids[k] > 0)
+            put_slot(table, entry->pids[k], entry);
+    PROBE2(bg_inserted, entry->pid, table->jobs->length);
+}
+
+bgentry_t* job_table_find(job_table_t* table, pid_t pid) {
+    job_slot_t* slot;
+
+    if (pid <= 0)
+        return NULL;
+    slot = find_slot(table, pid);
+    return slot != NULL ? slot->entry : NULL;
+}
+
+static void drop_pid(job_table_t* table, bgentry_t* entry, pid_t pid) {
+    job_slot_t* slot = find_slot(table, pid);
+
+    if (slot != NULL && slot->entry == entry) {
+        slot->pid = SLOT_FREED;
+        slot->entry = NULL;
+    }
+}
+
+void job_table_forget_pid(job_table_t* table, bgentry_t* entry, pid_t pid) {
+    // The leader's pid names the process group and can't be reused while
+    // the group has members, so the job stays reachable through it
+    if (pid == entry->pid && entry->nlive > 0)
+        return;
+    drop_pid(table, entry, pid);
+}
+
+void job_table_remove(job_table_t* table, bgentry_t* entry) {
+    int k;
+
+    for (k = 0; k < entry->npids; k++)
+        if (entry->pids[k] > 0)
+            drop_pid(table, entry, entry->pids[k]);
+    drop_pid(table, entry, entry->pid);
+    RemoveNode(table->jobs, entry->node);
+    entry->node = NULL;
+    PROBE2(bg_removed, entry->pid, table->jobs->length);
+}
+
+void print_job_table(job_table_t* table, FILE* fp) {
+    node_t* node;
+
+    for (node = table->jobs->head; node != NULL; node = node->next) {
+        bgentry_t* entry = node->data;
+        // print_bgentry's line, marked
+        if (entry->throttled)
+            fprintf(fp, THROTTLED_ENTRY, (unsigned long)entry->seconds, entry->pid, entry->job->line);
+        else
+            print_bgentry(entry);
+        fprintf(fp, "\n");
+    }
+}
+
+void print_job_table_usage(job_table_t* table, FILE* fp) {
+    node_t* node;
+
+    for (node = table->jobs->head; node != NULL; node = node->next) {
+        bgentry_t* entry = node->data;
+        double cpu = entry->usage.user + entry->usage.sys + live_cpu_seconds(entry->pids, entry->npids);
+        print_usage_entry(fp, entry->seconds, entry->pid, entry->throttled ? "throttled" : "running", cpu,
+                          &entry->usage, entry->job->line);
+    }
+}
+
+void free_job_table(job_table_t* table) {
+    DeleteList(table->jobs);
+    free(table->jobs);
+    free(table->slots);
+    free(table);
+}
@@ -0,0 +1,409 @@
+#define _GNU_SOURCE
+#include "launcher.h"
+#include "pathcache.h"
+#include "spawnserver.h"
+#include "zygote.h"
+#include "events.h"
+#include "proclimits.h"
+#include "trace.h"
+#include "shstat.h"
+#include "probes.h"
+
+#include <errno.h>
+#include <spawn.h>
+#include <sys/prctl.h>
+
+extern char** environ;
+
+// What runs an executable that isn't one the kernel knows, such as a script without #!
+#define SCRIPT_SHELL "/bin/sh"
+
+
+static bool same_file(char* a, char* b) {
+    return a != NULL && b != NULL && strcmp(a, b) == 0;
+}
+
+int open_redirections(job_info* job, proc_info* proc, bool first, bool last, redir_t* rd) {
+    char* in_file = first ? job->in_file : NULL;
+    char* out_file = last ? job->out_file : NULL;
+
+    rd->in_fd = rd->out_fd = rd->err_fd = -1;
+
+    // Same file shared for multiple types of redirection (&> shares out and err on purpose)
+    if (same_file(in_file, out_file) || same_file(in_file, proc->err_file) ||
+        (!job->outerr && same_file(out_file, proc->err_file))) {
+        fprintf(stderr, RD_ERR);
+        return -1;
+    }
+
+    if (in_file) {
+        rd->in_fd = open(in_file, O_RDONLY | O_CLOEXEC, 0);
+        if (rd->in_fd < 0) {
+            fprintf(stderr, RD_ERR);
+            return -1;
+        }
+    }
+
+    if (out_file) {
+        int flags = O_WRONLY | O_CREAT | O_CLOEXEC | (job->append ? O_APPEND : O_TRUNC);
+        rd->out_fd = open(out_file, flags, 0644);
+        if (rd->out_fd < 0) {
+            perror("Error opening output file");
+            close_redirections(rd);
+            return -1;
+        }
+    }
+
+    if (proc->err_file) {
+        if (job->outerr && same_file(out_file, proc->err_file))
+            rd->err_fd = fcntl(rd->out_fd, F_DUPFD_CLOEXEC, 0);
+        else
+            rd->err_fd = open(proc->err_file, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (rd->err_fd < 0) {
+            perror("Error opening error file");
+            close_redirections(rd);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void close_redirections(redir_t* rd) {
+    if (rd->in_fd >= 0)
+        close(rd->in_fd);
+    if (rd->out_fd >= 0)
+        close(rd->out_fd);
+    if (rd->err_fd >= 0)
+        close(rd->err_fd);
+    rd->in_fd = rd->out_fd = rd->err_fd = -1;
+}
+
+// The child side of spawn_limited; reports failure through err_pipe
+static void exec_limited(const char* path, char** argv, redir_t* rd, pid_t pgid, int err_pipe) {
+    struct sigaction sa;
+    int sig, err;
+
+    // The shell's handlers must not run in here: the memory is still the shell's
+    for (sig = 1; sig < NSIG; sig++)
+        if (sigaction(sig, NULL, &sa) == 0 && sa.sa_handler != SIG_IGN && sa.sa_handler != SIG_DFL)
+            signal(sig, SIG_DFL);
+    if (pgid >= 0 && setpgid(0, pgid) < 0)
+        goto fail;
+    if ((rd->in_fd >= 0 && dup2(rd->in_fd, STDIN_FILENO) < 0) ||
+        (rd->out_fd >= 0 && dup2(rd->out_fd, STDOUT_FILENO) < 0) ||
+        (rd->err_fd >= 0 && dup2(rd->err_fd, STDERR_FILENO) < 0))
+        goto fail;
+#ifdef CLOSE_RANGE_CLOEXEC
+    close_range(STDERR_FILENO + 1, ~0U, CLOSE_RANGE_CLOEXEC);
+#endif
+    if (apply_proc_limits(job_limits) < 0)
+        goto fail;
+    sigprocmask(SIG_SETMASK, child_sigmask(), NULL);
+    execv(path, argv);
+fail:
+    err = errno;
+    write(err_pipe, &err, sizeof(err));
+    _exit(127);
+}
+
+/*
+ * Starts path with job_limits applied in the child between vfork and exec,
+ * which posix_spawn has no room for. Returns an errno value.
+ */
+static int spawn_limited(const char* path, proc_info* proc, redir_t* rd, pid_t pgid, pid_t* pid) {
+    sigset_t all, old;
+    int err_pipe[2];
+    int err = 0;
+
+    if (pipe2(err_pipe, O_CLOEXEC) < 0)
+        return errno;
+    sigfillset(&all);
+    sigprocmask(SIG_BLOCK, &all, &old);
+    if ((*pid = vfork()) == 0)
+        exec_limited(path, proc->argv, rd, pgid, err_pipe[1]);
+    if (*pid < 0)
+        err = errno;
+    sigprocmask(SIG_SETMASK, &old, NULL);
+    close(err_pipe[1]);
+
+    // By now the child has exec'd, closing the pipe, or written why it couldn't
+    if (*pid > 0 && read(err_pipe[0], &err, sizeof(err)) == sizeof(err))
+        waitpid(*pid, NULL, 0);
+    close(err_pipe[0]);
+    return err;
+}
+
+// Starts path once, through the spawn server when there is one; returns an errno value
+static int spawn_path(const char* path, proc_info* proc, redir_t* rd, pid_t pgid, pid_t* pid) {
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attr;
+    int err;
+
+    if (job_limits != NULL)
+        return spawn_limited(path, proc, rd, pgid, pid);
+
+    if (spawn_server_running()) {
+        if ((*pid = spawn_server_launch(path, proc->argv, rd, pgid)) >= 0)
+            return 0;
+        if (errno != ENOSPC && errno != EAGAIN)
+            return errno;
+        // Too big for the server or the server died: spawn it ourselves
+    }
+
+    posix_spawn_file_actions_init(&actions);
+    if (rd->in_fd >= 0)
+        posix_spawn_file_actions_adddup2(&actions, rd->in_fd, STDIN_FILENO);
+    if (rd->out_fd >= 0)
+        posix_spawn_file_actions_adddup2(&actions, rd->out_fd, STDOUT_FILENO);
+    if (rd->err_fd >= 0)
+        posix_spawn_file_actions_adddup2(&actions, rd->err_fd, STDERR_FILENO);
+#if defined(__GLIBC__) && __GLIBC_PREREQ(2, 34)
+    // Don't leak anything the shell (or readline) holds open into the child
+    posix_spawn_file_actions_addclosefrom_np(&actions, STDERR_FILENO + 1);
+#endif
+
+    // Children must not inherit the shell's blocked SIGCHLD
+    posix_spawnattr_init(&attr);
+    posix_spawnattr_setsigmask(&attr, child_sigmask());
+    if (pgid >= 0) {
+        posix_spawnattr_setpgroup(&attr, pgid);
+        posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETPGROUP);
+    }
+    else
+        posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK);
+
+    err = posix_spawn(pid, path, &actions, &attr, proc->argv, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attr);
+    return err;
+}
+
+/*
+ * argv for running path with SCRIPT_SHELL, as execvp does when exec fails with ENOEXEC.
+ * The strings are argv's; free() only the array.
+ */
+static char** script_argv(const char* path, char** argv) {
+    char** sh_argv;
+    int argc;
+
+    for (argc = 0; argv[argc] != NULL; argc++)
+        ;
+    sh_argv = malloc((argc + 2) * sizeof(char*));
+    sh_argv[0] = SCRIPT_SHELL;
+    sh_argv[1] = (char*)path;
+    memcpy(sh_argv + 2, argv + 1, argc * sizeof(char*));  // argv[1..] and the NULL
+    return sh_argv;
+}
+
+// Starts path, or runs it with SCRIPT_SHELL if it turns out to be a script without #!
+static int spawn_command(const char* path, proc_info* proc, redir_t* rd, pid_t pgid, pid_t* pid) {
+    int err = spawn_path(path, proc, rd, pgid, pid);
+
+    if (err == ENOEXEC) {
+        proc_info script = *proc;
+        script.argv = script_argv(path, proc->argv);
+        err = spawn_path(SCRIPT_SHELL, &script, rd, pgid, pid);
+        free(script.argv);
+    }
+    return err;
+}
+
+pid_t launch_process(proc_info* proc, redir_t* rd, pid_t pgid) {
+    uint64_t start = TRACE_START();
+    uint64_t spawned = stat_clock();
+    const char* path;
+    pid_t pid;
+    int err;
+
+    PROBE2(spawn_start, proc->cmd, proc->argc);
+    // Script runs of the warm interpreter skip interpreter startup entirely
+    if (job_limits == NULL && zygote_accepts(proc) && (pid = zygote_launch(proc, rd, pgid)) >= 0) {
+        // The zygote's child may not have got there itself yet
+        if (pgid >= 0)
+            setpgid(pid, pgid ? pgid : pid);
+        shell_stats.spawns++;
+        stat_latency(shell_stats.spawn_us, spawned);
+        TRACE_SPAN("zygote", start, pid);
+        return pid;
+    }
+
+    path = lookup_command(proc->cmd);
+    if (path == NULL)
+        err = ENOENT;
+    else
+        err = spawn_command(path, proc, rd, pgid, &pid);
+    // The cached path went stale (moved, deleted, chmod); search PATH again once
+    if (path != NULL && path != proc->cmd && (err == ENOENT || err == EACCES || err == ENOTDIR)) {
+        forget_command(proc->cmd);
+        if ((path = lookup_command(proc->cmd)) != NULL)
+            err = spawn_command(path, proc, rd, pgid, &pid);
+    }
+    TRACE_SPAN("spawn", start, err == 0 ? pid : -1);
+    if (err != 0) {
+        PROBE2(exec_failed, proc->cmd, err);
+        shell_stats.exec_failures++;
+        errno = err;
+        return -1;
+    }
+    shell_stats.spawns++;
+    stat_latency(shell_stats.spawn_us, spawned);
+    return pid;
+}
+
+static void report_exec_error(proc_info* proc, redir_t* rd) {
+    // The child used to print this after its own dup2, so it lands in out_file,
+    // and after whatever the shell had printed so far
+    fflush(stdout);
+    dprintf(rd->out_fd >= 0 ? rd->out_fd : STDOUT_FILENO, EXEC_ERR, proc->cmd);
+}
+
+pid_t launch_job(job_info* job) {
+    uint64_t start = TRACE_START();
+    redir_t rd;
+    pid_t pid;
+
+    if (open_redirections(job, job->procs, true, true, &rd) < 0)
+        return -1;
+    TRACE_SPAN("redirect", start, 1);
+
+    // Background jobs get a process group of their own
+    pid = launch_process(job->procs, &rd, job->bg ? 0 : -1);
+    if (pid > 0)
+        PROBE3(stage_launched, pid, 0, job->procs->cmd);
+    if (pid < 0)
+        report_exec_error(job->procs, &rd);
+    close_redirections(&rd);
+    return pid;
+}
+
+int launch_pipeline(job_info* job, pid_t* pids) {
+    uint64_t start = TRACE_START();
+    redir_t* rd = malloc(job->nproc * sizeof(redir_t));
+    proc_info* proc;
+    int prev_read = -1;
+    // A background pipeline is one process group, led by its first process
+    pid_t pgid = job->bg ? 0 : -1;
+    int p[2];
+    int i;
+
+    // Open every redirection first so a bad file doesn't leave half a pipeline running
+    for (i = 0, proc = job->procs; proc != NULL; i++, proc = proc->next_proc) {
+        if (open_redirections(job, proc, i == 0, i == job->nproc - 1, &rd[i]) < 0) {
+            while (--i >= 0)
+                close_redirections(&rd[i]);
+            free(rd);
+            return -1;
+        }
+    }
+
+    // Launch all stages in one pass; each pipe only lives until both its ends are handed out
+    for (i = 0, proc = job->procs; proc != NULL; i++, proc = proc->next_proc) {
+        redir_t stage = rd[i];
+
+        p[0] = p[1] = -1;
+        if (proc->next_proc != NULL && pipe2(p, O_CLOEXEC) < 0) {
+            perror("pipe");
+            exit(EXIT_FAILURE);
+        }
+        if (stage.in_fd < 0)
+            stage.in_fd = prev_read;
+        if (stage.out_fd < 0)
+            stage.out_fd = p[1];
+
+        pids[i] = launch_process(proc, &stage, pgid);
+        if (pgid == 0 && pids[i] > 0)
+            pgid = pids[i];
+        if (pids[i] < 0)
+            report_exec_error(proc, &rd[i]);
+        else
+            PROBE3(stage_launched, pids[i], i, proc->cmd);
+
+        close_redirections(&rd[i]);
+        if (prev_read >= 0)
+            close(prev_read);
+        if (p[1] >= 0)
+            close(p[1]);
+        prev_read = p[0];
+    }
+
+    free(rd);
+    TRACE_SPAN("launch_pipeline", start, job->nproc);
+    return 0;
+}
+
+int redirect_shell(job_info* job, int* saved) {
+    redir_t rd;
+    int fds[3];
+    int i;
+
+    if (open_redirections(job, job->procs, true, true, &rd) < 0)
+        return -1;
+
+    fflush(stdout);
+    fflush(stderr);
+    fds[0] = rd.in_fd;
+    fds[1] = rd.out_fd;
+    fds[2] = rd.err_fd;
+    for (i = 0; i < 3; i++) {
+        if (saved != NULL)
+            saved[i] = -1;
+        if (fds[i] < 0)
+            continue;
+        if (saved != NULL)
+            saved[i] = fcntl(i, F_DUPFD_CLOEXEC, 10);
+        dup2(fds[i], i);
+    }
+    close_redirections(&rd);
+    return 0;
+}
+
+void restore_shell(int* saved) {
+    int i;
+
+    fflush(stdout);
+    fflush(stderr);
+    for (i = 0; i < 3; i++) {
+        if (saved[i] < 0)
+            continue;
+        dup2(saved[i], i);
+        close(saved[i]);
+        saved[i] = -1;
+    }
+}
+
+int exec_job(job_info* job) {
+    proc_info* proc = job->procs;
+    const char* path;
+    sigset_t blocked;
+    int saved[3];
+
+    if (redirect_shell(job, saved) < 0)
+        return -1;
+    // Like the child used to, errors go to the redirected stdout
+    if ((path = lookup_command(proc->cmd)) == NULL) {
+        printf(EXEC_ERR, proc->cmd);
+        restore_shell(saved);
+        return -1;
+    }
+
+    // Nothing of the shell should survive into the new program, but its trace
+    finish_tracing();
+    prctl(PR_SET_CHILD_SUBREAPER, 0);
+    sigprocmask(SIG_SETMASK, child_sigmask(), &blocked);
+    execv(path, proc->argv);
+    if (path != proc->cmd && (errno == ENOENT || errno == EACCES || errno == ENOTDIR)) {
+        forget_command(proc->cmd);
+        if ((path = lookup_command(proc->cmd)) != NULL)
+            execv(path, proc->argv);
+    }
+    if (errno == ENOEXEC && path != NULL) {
+        char** sh_argv = script_argv(path, proc->argv);
+        execv(SCRIPT_SHELL, sh_argv);
+        free(sh_argv);
+    }
+
+    sigprocmask(SIG_SETMASK, &blocked, NULL);
+    printf(EXEC_ERR, proc->cmd);
+    restore_shell(saved);
+    return -1;
+}
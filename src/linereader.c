@@ -0,0 +1,125 @@
+#include "linereader.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+line_reader_t* stdin_line_reader = NULL;
+
+
+line_reader_t* fd_line_reader(int fd) {
+    line_reader_t* r = malloc(sizeof(line_reader_t));
+    struct stat st;
+    r->fd = fd;
+    r->regular = fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+    r->cap = LINE_READER_BLOCK + 1;
+    r->buf = malloc(r->cap);
+    r->start = r->end = 0;
+    r->eof = false;
+    return r;
+}
+
+line_reader_t* string_line_reader(const char* s) {
+    line_reader_t* r = malloc(sizeof(line_reader_t));
+    r->fd = -1;
+    r->end = strlen(s);
+    r->cap = r->end + 1;
+    r->buf = malloc(r->cap);
+    memcpy(r->buf, s, r->cap);
+    r->start = 0;
+    r->eof = true;
+    r->regular = false;
+    return r;
+}
+
+// Reads another block behind the unread bytes; returns false at end of input
+static bool fill(line_reader_t* r) {
+    ssize_t n;
+
+    if (r->eof)
+        return false;
+
+    // Keep the partial line, drop what was handed out already
+    if (r->start > 0) {
+        memmove(r->buf, r->buf + r->start, r->end - r->start);
+        r->end -= r->start;
+        r->start = 0;
+    }
+    // A line longer than the buffer: make room for another block
+    if (r->cap - r->end < LINE_READER_BLOCK + 1) {
+        r->cap = r->end + LINE_READER_BLOCK + 1;
+        r->buf = realloc(r->buf, r->cap);
+    }
+
+    do {
+        n = read(r->fd, r->buf + r->end, LINE_READER_BLOCK);
+    } while (n < 0 && errno == EINTR);
+    if (n <= 0) {
+        r->eof = true;
+        return false;
+    }
+    r->end += n;
+    return true;
+}
+
+char* read_line(line_reader_t* r) {
+    size_t scanned = 0;
+    char* line;
+    char* nl;
+
+    for (;;) {
+        nl = memchr(r->buf + r->start + scanned, '\n', r->end - r->start - scanned);
+        if (nl != NULL)
+            break;
+        scanned = r->end - r->start;
+        if (!fill(r)) {
+            // Last line without a newline
+            if (r->start == r->end)
+                return NULL;
+            nl = r->buf + r->end;
+            break;
+        }
+    }
+
+    line = r->buf + r->start;
+    *nl = '\0';
+    r->start = nl - r->buf + (nl < r->buf + r->end ? 1 : 0);
+    if (r->start > r->end)
+        r->start = r->end;
+    return line;
+}
+
+bool line_reader_has_line(line_reader_t* r) {
+    if (r->start < r->end && (r->eof || memchr(r->buf + r->start, '\n', r->end - r->start) != NULL))
+        return true;
+    return r->regular && !r->eof;
+}
+
+bool line_reader_exhausted(line_reader_t* r) {
+    if (r->start < r->end)
+        return false;
+    return r->eof || fd_exhausted(r->fd);
+}
+
+bool fd_exhausted(int fd) {
+    struct pollfd pfd = { fd, POLLIN, 0 };
+    struct stat st;
+    int pending = 0;
+
+    if (fstat(fd, &st) < 0)
+        return false;
+    if (S_ISREG(st.st_mode))
+        return lseek(fd, 0, SEEK_CUR) >= st.st_size;
+    if (poll(&pfd, 1, 0) != 1 || !(pfd.revents & POLLHUP))
+        return false;
+    return ioctl(fd, FIONREAD, &pending) == 0 && pending == 0;
+}
+
+void free_line_reader(line_reader_t* r) {
+    free(r->buf);
+    free(r);
+}
@@ -1,4 +1,5 @@
 #include "linkedlist.h"
+#include "pool.h"
 #include <stdio.h>
 /*
     What is a linked list?
@@ -29,131 +30,113 @@ list_t* CreateList(int (*compare)(const void*, const void*), void (*print)(void*
     list->deleter = delete;
     list->length = 0;
     list->head = NULL;
+    list->tail = NULL;
+    list->back_links = false;
     return list;
 }
 
-void InsertAtHead(list_t* list, void* val_ref) {
-    if(list == NULL || val_ref == NULL)
-        return;
-    if (list->length == 0) list->head = NULL;
+void KeepBackLinks(list_t* list) {
+    assert(list->length == 0);
+    list->back_links = true;
+}
+
+// Links node in after prev (at the head if prev is NULL)
+static void LinkAfter(list_t* list, node_t* prev, node_t* node) {
+    node_t* next = prev != NULL ? prev->next : list->head;
+
+    node->next = next;
+    node->prev = list->back_links ? prev : NULL;
+    if (prev != NULL)
+        prev->next = node;
+    else
+        list->head = node;
+    if (next == NULL)
+        list->tail = node;
+    else if (list->back_links)
+        next->prev = node;
+    list->length++;
+}
+
+// Unlinks node, whose predecessor is prev
+static void Unlink(list_t* list, node_t* prev, node_t* node) {
+    if (prev != NULL)
+        prev->next = node->next;
+    else
+        list->head = node->next;
+    if (node->next == NULL)
+        list->tail = prev;
+    else if (list->back_links)
+        node->next->prev = prev;
+    list->length--;
+}
 
-    node_t** head = &(list->head);
-    node_t* new_node;
-    new_node = malloc(sizeof(node_t));
+// Nodes of every list come from one pool
+static pool_t node_pool = POOL_INITIALIZER("list nodes", node_t);
 
+static node_t* NewNode(void* val_ref) {
+    node_t* new_node = pool_alloc(&node_pool);
     new_node->data = val_ref;
+    new_node->next = NULL;
+    new_node->prev = NULL;
+    return new_node;
+}
 
-    new_node->next = *head;
+node_t* InsertAtHead(list_t* list, void* val_ref) {
+    if(list == NULL || val_ref == NULL)
+        return NULL;
 
-    // moves list head to the new node
-    *head = new_node;
-    list->length++;
+    node_t* new_node = NewNode(val_ref);
+    LinkAfter(list, NULL, new_node);
+    return new_node;
 }
 
-void InsertAtTail(list_t* list, void* val_ref) {
+node_t* InsertAtTail(list_t* list, void* val_ref) {
     if (list == NULL || val_ref == NULL)
-        return;
-    if (list->length == 0) {
-        InsertAtHead(list, val_ref);
-        return;
-    }
-
-    node_t* head = list->head;
-    node_t* current = head;
-    while (current->next != NULL) {
-        current = current->next;
-    }
+        return NULL;
 
-    current->next = malloc(sizeof(node_t));
-    current->next->data = val_ref;
-    current->next->next = NULL;
-    list->length++;
+    node_t* new_node = NewNode(val_ref);
+    LinkAfter(list, list->tail, new_node);
+    return new_node;
 }
 
-void InsertInOrder(list_t* list, void* val_ref) {
+node_t* InsertInOrder(list_t* list, void* val_ref) {
     if(list == NULL || val_ref == NULL)
-        return;
-    if (list->length == 0) {
-        InsertAtHead(list, val_ref);
-        return;
-    }
+        return NULL;
+    if (list->length == 0 || list->comparator(val_ref, list->tail->data) >= 0)
+        return InsertAtTail(list, val_ref);  // the common case of values arriving in order
 
-    node_t** head = &(list->head);
-    node_t* new_node;
-    new_node = malloc(sizeof(node_t));
-    new_node->data = val_ref;
-    new_node->next = NULL;
+    node_t* new_node = NewNode(val_ref);
+    node_t* prev = NULL;
 
-    if (list->comparator(new_node->data, (*head)->data) < 0) {
-        new_node->next = *head;
-        *head = new_node;
-    } else if ((*head)->next == NULL) {
-        (*head)->next = new_node;
+    if (list->back_links) {
+        // Walk back from the tail, past everything greater than the new value
+        prev = list->tail;
+        while (prev != NULL && list->comparator(val_ref, prev->data) < 0)
+            prev = prev->prev;
     } else {
-        node_t* prev = *head;
-        node_t* current = prev->next;
-        while (current != NULL) {
-            if (list->comparator(new_node->data, current->data) > 0) {
-                if (current->next != NULL) {
-                    prev = current;
-                    current = current->next;
-                } else {
-                    current->next = new_node;
-                    break;
-                }
-            } else {
-                prev->next = new_node;
-                new_node->next = current;
-                break;
-            }
+        // Insert after the last value not greater than the new one
+        node_t* current = list->head;
+        while (current != NULL && list->comparator(val_ref, current->data) >= 0) {
+            prev = current;
+            current = current->next;
         }
     }
-    list->length++;
+    LinkAfter(list, prev, new_node);
+    return new_node;
 }
 
 void* RemoveFromHead(list_t* list) {
-    node_t** head = &(list->head);
-    void* retval = NULL;
-    node_t* next_node = NULL;
-
     if (list->length == 0) {
         return NULL;
     }
-
-    next_node = (*head)->next;
-
-    retval = (*head)->data;
-    list->length--;
-
-    node_t* temp = *head;
-    *head = next_node;
-    free(temp);
-
-    return retval;
+    return RemoveNode(list, list->head);
 }
 
 void* RemoveFromTail(list_t* list) {
     if (list->length == 0) {
         return NULL;
-    } else if (list->length == 1) {
-        return RemoveFromHead(list);
     }
-
-    void* retval = NULL;
-    node_t* head = list->head;
-    node_t* current = head;
-
-    while (current->next->next != NULL) { 
-        current = current->next;
-    }
-
-    retval = current->next->data;
-    free(current->next);
-    current->next = NULL;
-
-    list->length--;
-
-    return retval;
+    return RemoveNode(list, list->tail);
 }
 
 /* indexed by 0 */
@@ -162,34 +145,35 @@ void* RemoveByIndex(list_t* list, int index) {
         return NULL;
     }
 
-    node_t** head = &(list->head);
-    void* retval = NULL;
-    node_t* current = *head;
+    node_t* current = list->head;
     node_t* prev = NULL;
     int i = 0;
 
-    if (index == 0) {
-        retval = (*head)->data;
-        
-		node_t* temp = *head;
-        *head = current->next;
-        free(temp);
-        
-		list->length--;
-        return retval;
-    }
-
     while (i++ != index) {
         prev = current;
         current = current->next;
     }
 
-    prev->next = current->next;
-    retval = current->data;
-    free(current);
+    void* retval = current->data;
+    Unlink(list, prev, current);
+    pool_free(&node_pool, current);
+    return retval;
+}
 
-    list->length--;
+void* RemoveNode(list_t* list, node_t* node) {
+    node_t* prev = NULL;
 
+    if (list->back_links)
+        prev = node->prev;
+    else if (node != list->head) {
+        prev = list->head;
+        while (prev->next != node)
+            prev = prev->next;
+    }
+
+    void* retval = node->data;
+    Unlink(list, prev, node);
+    pool_free(&node_pool, node);
     return retval;
 }
 
@@ -202,31 +186,59 @@ void DeleteList(list_t* list) {
     list->length = 0;
 }
 
-void SortList(list_t* list) {
-    list_t* new_list = malloc(sizeof(list_t));	
-    
-	new_list->length = 0;
-    new_list->comparator = list->comparator;
-    new_list->head = NULL;
-
-    int i = 0;
-    int len = list->length;
-    for (; i < len; ++i)
-    {
-        void* val = RemoveFromTail(list);
-        InsertInOrder(new_list, val); 
+// Merges two sorted chains; on ties the node from a comes first, which keeps the sort stable
+static node_t* MergeChains(list_t* list, node_t* a, node_t* b) {
+    node_t merged;
+    node_t* tail = &merged;
+
+    while (a != NULL && b != NULL) {
+        if (list->comparator(b->data, a->data) < 0) {
+            tail->next = b;
+            b = b->next;
+        } else {
+            tail->next = a;
+            a = a->next;
+        }
+        tail = tail->next;
     }
+    tail->next = a != NULL ? a : b;
+    return merged.next;
+}
 
-    node_t* temp = list->head;
-    list->head = new_list->head;
+void SortList(list_t* list) {
+    node_t* runs[sizeof(int) * 8 + 1] = { NULL };
+    node_t* current = list->head;
+    node_t* prev = NULL;
+    int max_run = 0;
+    int i;
 
-    new_list->head = temp;
-    list->length = new_list->length;  
+    // Bottom-up: runs[i] holds a sorted chain of 2^i nodes, merged like a binary counter
+    while (current != NULL) {
+        node_t* chain = current;
+        current = current->next;
+        chain->next = NULL;
+        for (i = 0; runs[i] != NULL; i++) {
+            chain = MergeChains(list, runs[i], chain);
+            runs[i] = NULL;
+        }
+        runs[i] = chain;
+        if (i > max_run)
+            max_run = i;
+    }
 
-    DeleteList(new_list);
-    free(new_list);  
+    // Higher runs hold earlier nodes, so they go on the left
+    current = NULL;
+    for (i = 0; i <= max_run; i++)
+        if (runs[i] != NULL)
+            current = current == NULL ? runs[i] : MergeChains(list, runs[i], current);
+    list->head = current;
+
+    // Restore the tail and the back links
+    for (; current != NULL; prev = current, current = current->next)
+        if (list->back_links)
+            current->prev = prev;
+    list->tail = prev;
 }
-
 void PrintLinkedList(list_t* list, FILE* fp) {
     if(list == NULL)
         return;
@@ -0,0 +1,338 @@
+#define _GNU_SOURCE
+#include "parallel.h"
+#include "helpers.h"
+#include "launcher.h"
+#include "linereader.h"
+#include "events.h"
+#include "probes.h"
+#include "shstat.h"
+
+#include <errno.h>
+#include <sys/mman.h>
+
+#define PARALLEL_USAGE "parallel: usage: parallel [-j jobs] [-k] [-X] [-s] [-a file] command [args]\n"
+
+// Like GNU parallel, the exit status counts failures up to this
+#define PARALLEL_MAX_STATUS 101
+
+// Left free below ARG_MAX when packing items, for the kernel's own bookkeeping
+#define ARG_HEADROOM 4096
+
+extern char** environ;
+
+typedef struct {
+    int first;      // index of the first item of the command
+    int count;      // number of items it got
+    pid_t pid;      // -1 once reaped or if it never started
+    uint64_t launched;  // stat_clock() when it started
+    int out_fd;     // memfd holding its output with -k, else -1
+    int status;     // exit status, 128+signal if it was killed
+    bool done;
+} task_t;
+
+typedef struct {
+    char** template;  // command words, {} marks where items go
+    int nwords;
+    bool has_slot;    // some word contains {}
+    char** items;
+    int nitems;
+    task_t* tasks;
+    int ntasks;
+    int max_running;
+    bool keep_order;
+    bool pack;
+    bool summary;
+} parallel_t;
+
+
+// Returns word with every {} replaced by item, in new memory
+static char* substitute(const char* word, const char* item) {
+    size_t item_len = strlen(item);
+    size_t len = 0;
+    const char* p;
+    char* out;
+    char* q;
+
+    for (p = word; *p; p++)
+        len += (p[0] == '{' && p[1] == '}') ? (p++, item_len) : 1;
+    out = q = malloc(len + 1);
+    for (p = word; *p; p++) {
+        if (p[0] == '{' && p[1] == '}') {
+            q = mempcpy(q, item, item_len);
+            p++;
+        }
+        else
+            *q++ = *p;
+    }
+    *q = '\0';
+    return out;
+}
+
+// Builds the argv of a command running items [first, first + count)
+static char** build_argv(parallel_t* par, int first, int count, int* argc) {
+    int max = par->nwords + (par->has_slot ? par->nwords * count : count) + 1;
+    char** argv = malloc(max * sizeof(char*));
+    int n = 0;
+    int i, k;
+
+    for (i = 0; i < par->nwords; i++) {
+        if (strstr(par->template[i], "{}") == NULL)
+            argv[n++] = strdup(par->template[i]);
+        else
+            for (k = 0; k < count; k++)
+                argv[n++] = substitute(par->template[i], par->items[first + k]);
+    }
+    if (!par->has_slot)
+        for (k = 0; k < count; k++)
+            argv[n++] = strdup(par->items[first + k]);
+    argv[n] = NULL;
+    *argc = n;
+    return argv;
+}
+
+static void free_argv(char** argv) {
+    int i;
+    for (i = 0; argv[i] != NULL; i++)
+        free(argv[i]);
+    free(argv);
+}
+
+// Bytes the kernel charges for the argument and environment strings of an exec
+static long arg_space(char* s) {
+    return strlen(s) + 1 + sizeof(char*);
+}
+
+/*
+ * Splits the items into commands. With -X each command takes as many items
+ * as fit in ARG_MAX, but no more than an even share, so every slot gets work.
+ */
+static void plan_tasks(parallel_t* par) {
+    long budget = sysconf(_SC_ARG_MAX) - ARG_HEADROOM;
+    int share = (par->nitems + par->max_running - 1) / par->max_running;
+    long fixed = sizeof(char*);
+    int i, k;
+
+    par->tasks = malloc((par->nitems > 0 ? par->nitems : 1) * sizeof(task_t));
+    par->ntasks = 0;
+
+    for (i = 0; environ[i] != NULL; i++)
+        budget -= arg_space(environ[i]);
+    for (i = 0; i < par->nwords; i++)
+        if (strstr(par->template[i], "{}") == NULL)
+            fixed += arg_space(par->template[i]);
+
+    for (i = 0; i < par->nitems; i += k) {
+        long used = fixed;
+        for (k = 0; i + k < par->nitems && (k == 0 || par->pack); k++) {
+            long cost = 0;
+            int w;
+            if (par->has_slot) {
+                for (w = 0; w < par->nwords; w++)
+                    if (strstr(par->template[w], "{}") != NULL)
+                        cost += arg_space(par->template[w]) + strlen(par->items[i + k]);
+            }
+            else
+                cost = arg_space(par->items[i + k]);
+            // A lone item always gets its command; exec reports if it is too big
+            if (k > 0 && (used + cost > budget || k >= share))
+                break;
+            used += cost;
+        }
+        task_t* task = &par->tasks[par->ntasks++];
+        task->first = i;
+        task->count = k;
+        task->pid = -1;
+        task->out_fd = -1;
+        task->status = 0;
+        task->done = false;
+    }
+}
+
+// Reads the items, one per line; from a script on stdin they are the rest of it
+static void read_items(parallel_t* par, int fd) {
+    line_reader_t* reader = fd == STDIN_FILENO && stdin_line_reader != NULL ? stdin_line_reader : fd_line_reader(fd);
+    int cap = 64;
+    char* line;
+
+    par->items = malloc(cap * sizeof(char*));
+    par->nitems = 0;
+    while ((line = read_line(reader)) != NULL) {
+        if (par->nitems == cap) {
+            cap *= 2;
+            par->items = realloc(par->items, cap * sizeof(char*));
+        }
+        par->items[par->nitems++] = strdup(line);
+    }
+    if (reader != stdin_line_reader)
+        free_line_reader(reader);
+}
+
+// Starts a task; a command that can't be executed fails like its child would
+static void start_task(parallel_t* par, task_t* task, redir_t* rd) {
+    redir_t child = *rd;
+    proc_info proc = { 0 };
+
+    proc.argv = build_argv(par, task->first, task->count, &proc.argc);
+    proc.cmd = proc.argv[0];
+    if (par->keep_order) {
+        task->out_fd = memfd_create("parallel", MFD_CLOEXEC);
+        if (task->out_fd >= 0)
+            child.out_fd = task->out_fd;
+    }
+
+    task->pid = launch_process(&proc, &child, -1);
+    if (task->pid < 0) {
+        dprintf(child.out_fd >= 0 ? child.out_fd : STDOUT_FILENO, EXEC_ERR, proc.cmd);
+        task->status = EXIT_FAILURE;
+        task->done = true;
+    }
+    else {
+        task->launched = stat_clock();
+        PROBE3(stage_launched, task->pid, 0, proc.cmd);
+    }
+    free_argv(proc.argv);
+}
+
+// Copies a finished task's buffered output to where parallel's output goes
+static void flush_task(task_t* task, int out_fd) {
+    if (task->out_fd < 0)
+        return;
+    copy_file_to(task->out_fd, out_fd);
+    close(task->out_fd);
+    task->out_fd = -1;
+}
+
+// Runs every task with at most max_running children at a time
+static void run_tasks(parallel_t* par, redir_t* rd, job_table_t* bg_job_list, int* last_child_status) {
+    int out_fd = rd->out_fd >= 0 ? rd->out_fd : STDOUT_FILENO;
+    int next = 0;       // next task to start
+    int flushed = 0;    // tasks whose output has been written, with -k
+    int running = 0;
+    struct rusage usage;
+    int status;
+    pid_t pid;
+    int i;
+
+    fflush(stdout);
+    if (wait_hook != NULL)
+        wait_hook();
+
+    while (next < par->ntasks || running > 0) {
+        while (next < par->ntasks && running < par->max_running) {
+            start_task(par, &par->tasks[next], rd);
+            if (par->tasks[next++].pid > 0)
+                running++;
+        }
+
+        if (running > 0) {
+            if ((pid = wait_child(&status, &usage)) < 0) {
+                printf(WAIT_ERR);
+                exit(EXIT_FAILURE);
+            }
+            for (i = 0; i < next && par->tasks[i].pid != pid; i++)
+                ;
+            if (i == next) {
+                // Not ours: a background job of the shell
+                reap_child(bg_job_list, pid, status, &usage, last_child_status);
+                continue;
+            }
+            usage_add(&fg_usage, &usage);
+            PROBE3(child_reaped, pid, status, (long)((stat_clock() - par->tasks[i].launched) / 1000));
+            par->tasks[i].pid = -1;
+            par->tasks[i].done = true;
+            par->tasks[i].status = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+            running--;
+        }
+
+        // Output goes out in input order as soon as everything before it is done
+        while (flushed < next && par->tasks[flushed].done)
+            flush_task(&par->tasks[flushed++], out_fd);
+    }
+}
+
+void handle_parallel_command(job_info* job, job_table_t* bg_job_list, int* last_child_status) {
+    proc_info* proc = job->procs;
+    parallel_t par = { 0 };
+    char* items_file = NULL;
+    redir_t rd;
+    int items_fd;
+    int failed = 0;
+    int i, k;
+
+    par.max_running = sysconf(_SC_NPROCESSORS_ONLN);
+    for (i = 1; i < proc->argc && proc->argv[i][0] == '-'; i++) {
+        char* opt = proc->argv[i];
+        if (strcmp(opt, "--") == 0) {
+            i++;
+            break;
+        }
+        else if (strcmp(opt, "-j") == 0 && i + 1 < proc->argc)
+            par.max_running = atoi(proc->argv[++i]);
+        else if (strcmp(opt, "-a") == 0 && i + 1 < proc->argc)
+            items_file = proc->argv[++i];
+        else if (strcmp(opt, "-k") == 0)
+            par.keep_order = true;
+        else if (strcmp(opt, "-X") == 0)
+            par.pack = true;
+        else if (strcmp(opt, "-s") == 0)
+            par.summary = true;
+        else
+            break;
+    }
+    if (i == proc->argc || par.max_running < 1) {
+        fprintf(stderr, PARALLEL_USAGE);
+        *last_child_status = 2;
+        free_job(job);
+        return;
+    }
+    par.template = proc->argv + i;
+    par.nwords = proc->argc - i;
+    for (k = 0; k < par.nwords; k++)
+        if (strstr(par.template[k], "{}") != NULL)
+            par.has_slot = true;
+
+    if (open_redirections(job, proc, true, true, &rd) < 0) {
+        *last_child_status = EXIT_FAILURE;
+        free_job(job);
+        return;
+    }
+    if (items_file != NULL) {
+        if ((items_fd = open(items_file, O_RDONLY | O_CLOEXEC)) < 0) {
+            perror(items_file);
+            close_redirections(&rd);
+            *last_child_status = EXIT_FAILURE;
+            free_job(job);
+            return;
+        }
+    }
+    else
+        items_fd = rd.in_fd >= 0 ? rd.in_fd : STDIN_FILENO;
+    read_items(&par, items_fd);
+    if (items_file != NULL)
+        close(items_fd);
+
+    // The commands don't share the items' input
+    if (rd.in_fd >= 0)
+        close(rd.in_fd);
+    rd.in_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+
+    plan_tasks(&par);
+    run_tasks(&par, &rd, bg_job_list, last_child_status);
+
+    for (i = 0; i < par.ntasks; i++) {
+        task_t* task = &par.tasks[i];
+        if (task->status != 0)
+            failed++;
+        if (par.summary)
+            for (k = 0; k < task->count; k++)
+                fprintf(stderr, "%d\t%s\n", task->status, par.items[task->first + k]);
+    }
+    *last_child_status = failed < PARALLEL_MAX_STATUS ? failed : PARALLEL_MAX_STATUS;
+
+    close_redirections(&rd);
+    for (i = 0; i < par.nitems; i++)
+        free(par.items[i]);
+    free(par.items);
+    free(par.tasks);
+    free_job(job);
+}
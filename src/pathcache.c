@@ -0,0 +1,232 @@
+#include "pathcache.h"
+
+#include <limits.h>
+#include <sys/stat.h>
+
+/*
+ * Command name -> resolved path, chained hash table.
+ * A NULL path is a negative entry ("not found") that expires after
+ * HASH_NEGATIVE_TTL_MS so newly installed commands are picked up.
+ */
+typedef struct hash_entry {
+    char* name;
+    char* path;                 // NULL if the command was not found
+    int hits;                   // number of times the entry answered a lookup
+    bool relative;              // found through a relative PATH directory
+    struct timespec expires;    // only meaningful for negative entries
+    struct hash_entry* next;
+} hash_entry_t;
+
+#define HASH_INITIAL_BUCKETS 64
+
+static hash_entry_t** buckets = NULL;
+static int nbuckets = 0;
+static int nentries = 0;
+static char* cached_path_var = NULL;  // value of PATH the entries were resolved with
+
+
+static unsigned int hash_name(const char* name) {
+    unsigned int h = 5381;
+    while (*name)
+        h = h * 33 + (unsigned char)*name++;
+    return h;
+}
+
+static void free_entry(hash_entry_t* e) {
+    free(e->name);
+    free(e->path);
+    free(e);
+}
+
+static void grow_table(void) {
+    int new_n = nbuckets ? nbuckets * 2 : HASH_INITIAL_BUCKETS;
+    hash_entry_t** new_buckets = calloc(new_n, sizeof(hash_entry_t*));
+    int i;
+
+    for (i = 0; i < nbuckets; i++) {
+        hash_entry_t* e = buckets[i];
+        while (e != NULL) {
+            hash_entry_t* next = e->next;
+            unsigned int b = hash_name(e->name) % new_n;
+            e->next = new_buckets[b];
+            new_buckets[b] = e;
+            e = next;
+        }
+    }
+    free(buckets);
+    buckets = new_buckets;
+    nbuckets = new_n;
+}
+
+// Removes every entry matching keep == false
+static void prune(bool (*keep)(hash_entry_t*)) {
+    int i;
+    for (i = 0; i < nbuckets; i++) {
+        hash_entry_t** link = &buckets[i];
+        while (*link != NULL) {
+            hash_entry_t* e = *link;
+            if (keep != NULL && keep(e)) {
+                link = &e->next;
+                continue;
+            }
+            *link = e->next;
+            free_entry(e);
+            nentries--;
+        }
+    }
+}
+
+void clear_path_cache(void) {
+    prune(NULL);
+}
+
+static bool is_absolute(hash_entry_t* e) {
+    return !e->relative;
+}
+
+void path_cache_cwd_changed(void) {
+    prune(is_absolute);
+}
+
+// Throws the cache away if PATH is not what it was resolved with
+static void check_path_var(void) {
+    const char* path_var = getenv("PATH");
+    if (path_var == NULL)
+        path_var = "";
+    if (cached_path_var != NULL && strcmp(cached_path_var, path_var) == 0)
+        return;
+    clear_path_cache();
+    free(cached_path_var);
+    cached_path_var = strdup(path_var);
+}
+
+static bool negative_expired(hash_entry_t* e) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec > e->expires.tv_sec ||
+           (now.tv_sec == e->expires.tv_sec && now.tv_nsec >= e->expires.tv_nsec);
+}
+
+static hash_entry_t* find_entry(const char* cmd, hash_entry_t*** link_out) {
+    hash_entry_t** link;
+    if (nbuckets == 0)
+        return NULL;
+    for (link = &buckets[hash_name(cmd) % nbuckets]; *link != NULL; link = &(*link)->next) {
+        if (strcmp((*link)->name, cmd) == 0) {
+            if (link_out)
+                *link_out = link;
+            return *link;
+        }
+    }
+    return NULL;
+}
+
+// Walks PATH the way execvp does; returns a malloced path or NULL
+static char* search_path(const char* cmd, bool* relative) {
+    const char* dirs = cached_path_var;
+    char candidate[PATH_MAX];
+    struct stat st;
+
+    while (dirs != NULL) {
+        const char* end = strchr(dirs, ':');
+        int len = end ? (int)(end - dirs) : (int)strlen(dirs);
+
+        // An empty PATH entry means the current directory
+        if (len == 0)
+            snprintf(candidate, sizeof(candidate), "./%s", cmd);
+        else
+            snprintf(candidate, sizeof(candidate), "%.*s/%s", len, dirs, cmd);
+
+        if (stat(candidate, &st) == 0 && S_ISREG(st.st_mode) && access(candidate, X_OK) == 0) {
+            *relative = candidate[0] != '/';
+            return strdup(candidate);
+        }
+        dirs = end ? end + 1 : NULL;
+    }
+    return NULL;
+}
+
+const char* lookup_command(const char* cmd) {
+    hash_entry_t* e;
+
+    if (strchr(cmd, '/') != NULL)
+        return cmd;
+
+    check_path_var();
+    e = find_entry(cmd, NULL);
+    if (e != NULL && (e->path != NULL || !negative_expired(e))) {
+        e->hits++;
+        return e->path;
+    }
+
+    if (e == NULL) {
+        if (nentries >= nbuckets)
+            grow_table();
+        e = calloc(1, sizeof(hash_entry_t));
+        e->name = strdup(cmd);
+        unsigned int b = hash_name(cmd) % nbuckets;
+        e->next = buckets[b];
+        buckets[b] = e;
+        nentries++;
+    }
+
+    e->path = search_path(cmd, &e->relative);
+    e->hits = 1;
+    if (e->path == NULL) {
+        clock_gettime(CLOCK_MONOTONIC, &e->expires);
+        e->expires.tv_sec += HASH_NEGATIVE_TTL_MS / 1000;
+        e->expires.tv_nsec += (HASH_NEGATIVE_TTL_MS % 1000) * 1000000L;
+        if (e->expires.tv_nsec >= 1000000000L) {
+            e->expires.tv_sec++;
+            e->expires.tv_nsec -= 1000000000L;
+        }
+    }
+    return e->path;
+}
+
+void forget_command(const char* cmd) {
+    hash_entry_t** link;
+    hash_entry_t* e = find_entry(cmd, &link);
+    if (e == NULL)
+        return;
+    *link = e->next;
+    free_entry(e);
+    nentries--;
+}
+
+void handle_hash_command(job_info* job) {
+    proc_info* proc = job->procs;
+    int i;
+
+    if (proc->argc == 1) {
+        check_path_var();
+        if (nentries == 0)
+            printf("hash: hash table empty\n");
+        else
+            printf("hits\tcommand\n");
+        for (i = 0; i < nbuckets; i++) {
+            hash_entry_t* e;
+            for (e = buckets[i]; e != NULL; e = e->next) {
+                if (e->path != NULL)
+                    printf("%4d\t%s\n", e->hits, e->path);
+                else if (!negative_expired(e))
+                    printf("%4d\t%s (not found)\n", e->hits, e->name);
+            }
+        }
+    }
+    else if (strcmp(proc->argv[1], "-r") == 0) {
+        clear_path_cache();
+    }
+    else if (strcmp(proc->argv[1], "-d") == 0) {
+        for (i = 2; i < proc->argc; i++)
+            forget_command(proc->argv[i]);
+    }
+    else {
+        for (i = 1; i < proc->argc; i++) {
+            // Pre-warming only makes sense for names that need a PATH search
+            if (strchr(proc->argv[i], '/') == NULL && lookup_command(proc->argv[i]) == NULL)
+                fprintf(stderr, "hash: %s: not found\n", proc->argv[i]);
+        }
+    }
+    free_job(job);
+}
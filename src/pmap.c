@@ -0,0 +1,279 @@
+#define _GNU_SOURCE
+#include "pmap.h"
+#include "helpers.h"
+#include "launcher.h"
+#include "probes.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define PMAP_USAGE "pmap: usage: pmap [-j copies] command [args] [| command ...] < file\n"
+#define PMAP_INPUT_ERR "pmap: input must be a regular file\n"
+
+// Bytes handed to one write while feeding the copies
+#define PMAP_WRITE_BLOCK (256 * 1024)
+
+typedef struct {
+    const char* next;   // next byte of the chunk to feed
+    const char* end;
+    int in_fd;          // write end of the copy's stdin, -1 once fed
+    int out_fd;         // memfd collecting its output, -1 for the first copy
+} pmap_copy_t;
+
+
+/*
+ * Cuts data into n chunks of about the same size, each ending after a newline
+ * (or at the end of data); bounds gets n + 1 offsets.
+ */
+static void split_lines(const char* data, size_t size, int n, size_t* bounds) {
+    int i;
+
+    bounds[0] = 0;
+    for (i = 1; i < n; i++) {
+        size_t at = size / n * i;
+        const char* nl;
+        if (at < bounds[i - 1])
+            at = bounds[i - 1];
+        nl = at < size ? memchr(data + at, '\n', size - at) : NULL;
+        bounds[i] = nl != NULL ? (size_t)(nl - data) + 1 : size;
+    }
+    bounds[n] = size;
+}
+
+/*
+ * Starts one copy of the pipeline reading in_fd and writing out_fd.
+ * pids gets one pid per stage, -1 for stages that couldn't be executed.
+ */
+static void launch_copy(proc_info** stages, redir_t* rd, int nstages, int in_fd, int out_fd, pid_t* pids) {
+    int prev_read = in_fd;
+    int p[2];
+    int s;
+
+    for (s = 0; s < nstages; s++) {
+        redir_t stage = rd[s];
+
+        p[0] = p[1] = -1;
+        if (s < nstages - 1 && pipe2(p, O_CLOEXEC) < 0) {
+            perror("pipe");
+            exit(EXIT_FAILURE);
+        }
+        stage.in_fd = prev_read;
+        stage.out_fd = s < nstages - 1 ? p[1] : out_fd;
+
+        pids[s] = launch_process(stages[s], &stage, -1);
+        if (pids[s] < 0) {
+            fflush(stdout);
+            dprintf(stage.out_fd >= 0 ? stage.out_fd : STDOUT_FILENO, EXEC_ERR, stages[s]->cmd);
+        }
+        else
+            PROBE3(stage_launched, pids[s], s, stages[s]->cmd);
+
+        if (prev_read >= 0 && prev_read != in_fd)
+            close(prev_read);
+        if (p[1] >= 0)
+            close(p[1]);
+        prev_read = p[0];
+    }
+}
+
+/*
+ * Writes every chunk into its copy's stdin without blocking on any one of
+ * them. A copy that exits early (head) just stops getting input.
+ */
+static void feed_copies(pmap_copy_t* copies, int n) {
+    struct pollfd* fds = malloc(n * sizeof(struct pollfd));
+    sigset_t pipe_mask, old_mask;
+    struct timespec no_wait = { 0, 0 };
+    int open_fds = n;
+    int i;
+
+    // EPIPE instead of being killed by a copy that stopped reading
+    sigemptyset(&pipe_mask);
+    sigaddset(&pipe_mask, SIGPIPE);
+    sigprocmask(SIG_BLOCK, &pipe_mask, &old_mask);
+
+    while (open_fds > 0) {
+        for (i = 0; i < n; i++) {
+            fds[i].fd = copies[i].in_fd;
+            fds[i].events = POLLOUT;
+        }
+        if (poll(fds, n, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("poll");
+            break;
+        }
+        for (i = 0; i < n; i++) {
+            pmap_copy_t* copy = &copies[i];
+            ssize_t written = 0;
+
+            if (copy->in_fd < 0 || fds[i].revents == 0)
+                continue;
+            if (copy->next < copy->end) {
+                size_t len = copy->end - copy->next;
+                written = write(copy->in_fd, copy->next, len < PMAP_WRITE_BLOCK ? len : PMAP_WRITE_BLOCK);
+                if (written > 0)
+                    copy->next += written;
+            }
+            if (copy->next == copy->end || (written < 0 && errno != EAGAIN && errno != EINTR)) {
+                close(copy->in_fd);
+                copy->in_fd = -1;
+                open_fds--;
+            }
+        }
+    }
+
+    while (sigtimedwait(&pipe_mask, NULL, &no_wait) > 0)
+        ;
+    sigprocmask(SIG_SETMASK, &old_mask, NULL);
+    free(fds);
+}
+
+void handle_pmap_command(job_info* job, job_table_t* bg_job_list, int* last_child_status) {
+    proc_info first = *job->procs;
+    proc_info** stages = malloc(job->nproc * sizeof(proc_info*));
+    redir_t* rd = malloc(job->nproc * sizeof(redir_t));
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    pmap_copy_t* copies;
+    size_t* bounds;
+    pid_t* pids;
+    int* statuses;
+    char* data = NULL;
+    struct stat st;
+    int nstages = job->nproc;
+    int in_fd, out_fd;
+    int status = 0;
+    int i, s;
+
+    // pmap's own options come first; the rest of its process is the first stage
+    for (i = 1; i < first.argc && first.argv[i][0] == '-'; i++) {
+        if (strcmp(first.argv[i], "--") == 0) {
+            i++;
+            break;
+        }
+        else if (strcmp(first.argv[i], "-j") == 0 && i + 1 < first.argc)
+            n = atol(first.argv[++i]);
+        else
+            break;
+    }
+    if (i == first.argc || n < 1) {
+        fprintf(stderr, PMAP_USAGE);
+        *last_child_status = 2;
+        goto out;
+    }
+    first.argv += i;
+    first.argc -= i;
+    first.cmd = first.argv[0];
+    stages[0] = &first;
+    for (s = 1; s < nstages; s++)
+        stages[s] = stages[s - 1]->next_proc;
+
+    in_fd = job->in_file != NULL ? open(job->in_file, O_RDONLY | O_CLOEXEC) : STDIN_FILENO;
+    if (in_fd < 0) {
+        fprintf(stderr, RD_ERR);
+        *last_child_status = EXIT_FAILURE;
+        goto out;
+    }
+    if (fstat(in_fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+        fprintf(stderr, PMAP_INPUT_ERR);
+        *last_child_status = EXIT_FAILURE;
+        if (in_fd != STDIN_FILENO)
+            close(in_fd);
+        goto out;
+    }
+    if (st.st_size > 0 && (data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, in_fd, 0)) == MAP_FAILED) {
+        perror("mmap");
+        data = NULL;
+    }
+    if (in_fd != STDIN_FILENO)
+        close(in_fd);
+    if (data == NULL && st.st_size > 0) {
+        *last_child_status = EXIT_FAILURE;
+        goto out;
+    }
+    if (data != NULL)
+        madvise(data, st.st_size, MADV_SEQUENTIAL);
+
+    for (s = 0; s < nstages; s++) {
+        if (open_redirections(job, stages[s], false, s == nstages - 1, &rd[s]) < 0) {
+            while (--s >= 0)
+                close_redirections(&rd[s]);
+            *last_child_status = EXIT_FAILURE;
+            goto unmap;
+        }
+    }
+    out_fd = rd[nstages - 1].out_fd >= 0 ? rd[nstages - 1].out_fd : STDOUT_FILENO;
+
+    if (n > st.st_size / PMAP_MIN_CHUNK + 1)
+        n = st.st_size / PMAP_MIN_CHUNK + 1;
+
+    // The first copy writes straight to the output, the others into memfds appended after it;
+    // without a memfd a copy's output would come out of order, so there are fewer copies
+    copies = malloc(n * sizeof(pmap_copy_t));
+    copies[0].out_fd = -1;
+    for (i = 1; i < n; i++) {
+        if ((copies[i].out_fd = memfd_create("pmap", MFD_CLOEXEC)) < 0) {
+            perror("pmap: memfd_create");
+            n = i;
+        }
+    }
+    bounds = malloc((n + 1) * sizeof(size_t));
+    split_lines(data, st.st_size, n, bounds);
+
+    pids = malloc(n * nstages * sizeof(pid_t));
+    statuses = malloc(n * nstages * sizeof(int));
+    fflush(stdout);
+    for (i = 0; i < n; i++) {
+        int p[2];
+
+        if (pipe2(p, O_CLOEXEC) < 0) {
+            perror("pipe");
+            exit(EXIT_FAILURE);
+        }
+        fcntl(p[1], F_SETFL, O_NONBLOCK);
+        copies[i].next = data + bounds[i];
+        copies[i].end = data + bounds[i + 1];
+        copies[i].in_fd = p[1];
+
+        launch_copy(stages, rd, nstages, p[0], copies[i].out_fd >= 0 ? copies[i].out_fd : rd[nstages - 1].out_fd, pids + i * nstages);
+        close(p[0]);
+    }
+    // The last stage's redirections stay open for appending the output
+    for (s = 0; s < nstages - 1; s++)
+        close_redirections(&rd[s]);
+
+    // What a copy whose last stage never started would have exited with
+    for (i = 0; i < n * nstages; i++)
+        statuses[i] = EXIT_FAILURE << 8;
+    feed_copies(copies, n);
+    wait_for_processes(bg_job_list, pids, n * nstages, statuses, &fg_usage, last_child_status);
+
+    for (i = 0; i < n; i++) {
+        int wstatus = statuses[i * nstages + nstages - 1];
+        // A copy killed by a signal counts like it would in a shell, not as exit 0
+        int copy_status = WIFEXITED(wstatus) ? WEXITSTATUS(wstatus) : 128 + WTERMSIG(wstatus);
+
+        if (copy_status > status)
+            status = copy_status;
+        if (copies[i].out_fd >= 0) {
+            copy_file_to(copies[i].out_fd, out_fd);
+            close(copies[i].out_fd);
+        }
+    }
+    *last_child_status = status;
+
+    close_redirections(&rd[nstages - 1]);
+    free(bounds);
+    free(copies);
+    free(pids);
+    free(statuses);
+unmap:
+    if (data != NULL)
+        munmap(data, st.st_size);
+out:
+    free(stages);
+    free(rd);
+    free_job(job);
+}
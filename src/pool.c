@@ -0,0 +1,73 @@
+#include "pool.h"
+
+#include <stdlib.h>
+
+static pool_t* pools = NULL;  // every pool that has allocated, for print_pool_stats
+
+
+#ifndef NO_POOLS
+// Gets a new slab; its first word links it into the pool's slab list
+static void add_slab(pool_t* pool) {
+    size_t header = (sizeof(void*) + pool->size - 1) / pool->size * pool->size;
+    char* slab = malloc(header + pool->size * POOL_SLAB_OBJECTS);
+
+    if (slab == NULL)
+        return;
+    *(void**)slab = pool->slabs;
+    pool->slabs = slab;
+    pool->next = slab + header;
+    pool->end = pool->next + pool->size * POOL_SLAB_OBJECTS;
+    pool->nslabs++;
+}
+#endif
+
+void* pool_alloc(pool_t* pool) {
+    void* object;
+
+    if (!pool->listed) {
+        pool->registered = pools;
+        pools = pool;
+        pool->listed = 1;
+    }
+
+#ifdef NO_POOLS
+    object = malloc(pool->size);
+#else
+    if (pool->free_list != NULL) {
+        object = pool->free_list;
+        pool->free_list = *(void**)object;
+    }
+    else {
+        if (pool->next == pool->end)
+            add_slab(pool);
+        if (pool->next == pool->end)
+            return NULL;
+        object = pool->next;
+        pool->next += pool->size;
+    }
+#endif
+    if (object != NULL && ++pool->live > pool->peak)
+        pool->peak = pool->live;
+    return object;
+}
+
+void pool_free(pool_t* pool, void* object) {
+    if (object == NULL)
+        return;
+    pool->live--;
+#ifdef NO_POOLS
+    free(object);
+#else
+    *(void**)object = pool->free_list;
+    pool->free_list = object;
+#endif
+}
+
+void print_pool_stats(FILE* fp) {
+    pool_t* pool;
+
+    for (pool = pools; pool != NULL; pool = pool->registered)
+        fprintf(fp, "%s: %zu live, %zu peak, %zu slabs of %zu bytes\n",
+                pool->name, pool->live, pool->peak, pool->nslabs,
+                pool->size * POOL_SLAB_OBJECTS);
+}
@@ -0,0 +1,217 @@
+#define _GNU_SOURCE
+#include "proclimits.h"
+#include "helpers.h"
+
+#include <errno.h>
+#include <sched.h>
+#include <string.h>
+#include <sys/resource.h>
+
+struct proc_limits {
+    bool has_cpus;
+    cpu_set_t cpus;     // affinity
+    char* cpus_text;    // as given, e.g. 4-7 or 0,2
+    char* mem_text;
+    int nice;           // added to the shell's niceness; 0 leaves it
+    rlim_t mem;         // address space limit in bytes; 0 for none
+};
+
+const proc_limits_t* job_limits = NULL;
+
+static proc_limits_t prefix_limits;      // of the job with a run prefix
+static proc_limits_t default_limits;     // of background jobs
+static bool has_default = false;
+
+
+static void clear_limits(proc_limits_t* limits) {
+    free(limits->cpus_text);
+    free(limits->mem_text);
+    memset(limits, 0, sizeof(proc_limits_t));
+}
+
+// Parses a CPU list like 0,2,4-7; only CPUs the shell may run on count
+static bool parse_cpus(const char* s, cpu_set_t* cpus) {
+    cpu_set_t allowed;
+    long first, last;
+    char* end;
+
+    CPU_ZERO(cpus);
+    for (;;) {
+        first = strtol(s, &end, 10);
+        if (end == s || first < 0)
+            return false;
+        last = first;
+        if (*end == '-') {
+            s = end + 1;
+            last = strtol(s, &end, 10);
+            if (end == s || last < first)
+                return false;
+        }
+        if (last >= CPU_SETSIZE)
+            return false;
+        for (; first <= last; first++)
+            CPU_SET(first, cpus);
+        if (*end == '\0')
+            break;
+        if (*end != ',')
+            return false;
+        s = end + 1;
+    }
+
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0)
+        CPU_AND(cpus, cpus, &allowed);
+    return CPU_COUNT(cpus) > 0;
+}
+
+// Parses 2G, 512M, 100K or plain bytes
+static bool parse_size(const char* s, rlim_t* size) {
+    char* end;
+    double value = strtod(s, &end);
+
+    if (end == s || value <= 0)
+        return false;
+    switch (*end) {
+        case 'K': case 'k': value *= 1024; end++; break;
+        case 'M': case 'm': value *= 1024 * 1024; end++; break;
+        case 'G': case 'g': value *= 1024.0 * 1024 * 1024; end++; break;
+    }
+    if (*end != '\0')
+        return false;
+    *size = value;
+    return true;
+}
+
+/*
+ * Reads --cpus, --nice and --rss from argv starting at *i, leaving *i at
+ * the first word that isn't one. Returns false after reporting an error.
+ */
+static bool parse_options(proc_info* proc, int* i, proc_limits_t* limits) {
+    for (; *i < proc->argc; *i += 2) {
+        char* opt = proc->argv[*i];
+        char* value = proc->argv[*i + 1];
+        char* end;
+
+        if (strcmp(opt, "--") == 0) {
+            (*i)++;
+            break;
+        }
+        if (strncmp(opt, "--", 2) != 0)
+            break;
+        if (value == NULL) {
+            fprintf(stderr, RUN_USAGE);
+            return false;
+        }
+        if (strcmp(opt, "--cpus") == 0) {
+            if (!parse_cpus(value, &limits->cpus)) {
+                fprintf(stderr, RUN_CPUS_ERR, value);
+                return false;
+            }
+            limits->has_cpus = true;
+            free(limits->cpus_text);
+            limits->cpus_text = strdup(value);
+        }
+        else if (strcmp(opt, "--nice") == 0) {
+            limits->nice = strtol(value, &end, 10);
+            if (end == value || *end != '\0') {
+                fprintf(stderr, RUN_USAGE);
+                return false;
+            }
+        }
+        else if (strcmp(opt, "--rss") == 0) {
+            if (!parse_size(value, &limits->mem)) {
+                fprintf(stderr, RUN_USAGE);
+                return false;
+            }
+            free(limits->mem_text);
+            limits->mem_text = strdup(value);
+        }
+        else {
+            fprintf(stderr, RUN_USAGE);
+            return false;
+        }
+    }
+    return true;
+}
+
+static void print_limits(const proc_limits_t* limits) {
+    printf("run: default");
+    if (limits->has_cpus)
+        printf(" --cpus %s", limits->cpus_text);
+    if (limits->nice != 0)
+        printf(" --nice %d", limits->nice);
+    if (limits->mem != 0)
+        printf(" --rss %s", limits->mem_text);
+    printf("\n");
+}
+
+bool take_job_limits(job_info* job, int* last_child_status) {
+    proc_info* proc = job->procs;
+    int i = 1;
+
+    job_limits = job->bg && has_default ? &default_limits : NULL;
+    if (strcmp(proc->cmd, "run") != 0)
+        return true;
+
+    if (proc->argc == 1) {
+        if (has_default)
+            print_limits(&default_limits);
+        else
+            printf("run: no default\n");
+        free_job(job);
+        return false;
+    }
+
+    if (strcmp(proc->argv[1], "-d") == 0) {
+        proc_limits_t limits = { 0 };
+        i = 2;
+        if (!parse_options(proc, &i, &limits) || i != proc->argc) {
+            if (i != proc->argc)
+                fprintf(stderr, RUN_USAGE);
+            clear_limits(&limits);
+            *last_child_status = 2;
+        }
+        else {
+            clear_limits(&default_limits);
+            default_limits = limits;
+            has_default = limits.has_cpus || limits.nice != 0 || limits.mem != 0;
+            *last_child_status = 0;
+        }
+        free_job(job);
+        return false;
+    }
+
+    clear_limits(&prefix_limits);
+    if (!parse_options(proc, &i, &prefix_limits) || i == proc->argc) {
+        if (i == proc->argc)
+            fprintf(stderr, RUN_USAGE);
+        *last_child_status = 2;
+        free_job(job);
+        return false;
+    }
+    shift_words(proc, i);
+    job_limits = &prefix_limits;
+    return true;
+}
+
+int apply_proc_limits(const proc_limits_t* limits) {
+    struct rlimit rl;
+
+    if (limits->has_cpus && sched_setaffinity(0, sizeof(cpu_set_t), &limits->cpus) < 0)
+        return -1;
+    if (limits->nice != 0) {
+        errno = 0;
+        if (nice(limits->nice) == -1 && errno != 0)
+            return -1;
+    }
+    if (limits->mem != 0) {
+        // Both limits, so the program can't lift it; never above the shell's own
+        if (getrlimit(RLIMIT_AS, &rl) < 0)
+            return -1;
+        if (limits->mem < rl.rlim_max)
+            rl.rlim_max = limits->mem;
+        rl.rlim_cur = rl.rlim_max;
+        if (setrlimit(RLIMIT_AS, &rl) < 0)
+            return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,110 @@
+#include "shstat.h"
+
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+
+shell_stats_t shell_stats;
+
+
+uint64_t stat_clock(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void stat_latency(unsigned long* histogram, uint64_t start) {
+    uint64_t us = (stat_clock() - start) / 1000;
+    int bucket = 0;
+
+    // Bucket b > 0 holds [2^(b-1), 2^b) microseconds
+    while (us > 0 && bucket < STAT_BUCKETS - 1) {
+        us >>= 1;
+        bucket++;
+    }
+    histogram[bucket]++;
+}
+
+// Appends s at *p, never past end
+static char* put_str(char* p, char* end, const char* s) {
+    while (*s != '\0' && p < end)
+        *p++ = *s++;
+    return p;
+}
+
+static char* put_ulong(char* p, char* end, unsigned long n) {
+    char digits[24];
+    int len = 0;
+
+    do {
+        digits[len++] = '0' + n % 10;
+        n /= 10;
+    } while (n > 0);
+    while (len > 0 && p < end)
+        *p++ = digits[--len];
+    return p;
+}
+
+static void write_line(int fd, const char* name, const char* suffix, unsigned long bound, unsigned long value) {
+    char line[96];
+    char* end = line + sizeof(line) - 1;
+    char* p = put_str(line, end, name);
+
+    if (suffix != NULL) {
+        p = put_str(p, end, suffix);
+        p = put_ulong(p, end, bound);
+    }
+    p = put_str(p, end, " ");
+    p = put_ulong(p, end, value);
+    *p++ = '\n';
+    while (write(fd, line, p - line) < 0 && errno == EINTR)
+        ;
+}
+
+// One line per non-empty bucket: name_lt_<bound> or, for the last one, name_ge_<bound>
+static void write_histogram(int fd, const char* name, const unsigned long* histogram) {
+    int b;
+
+    for (b = 0; b < STAT_BUCKETS; b++) {
+        if (histogram[b] == 0)
+            continue;
+        if (b == STAT_BUCKETS - 1)
+            write_line(fd, name, "_ge_", 1UL << (b - 1), histogram[b]);
+        else
+            write_line(fd, name, "_lt_", 1UL << b, histogram[b]);
+    }
+}
+
+void write_shell_stats(int fd) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_REALTIME, &now);
+    write_line(fd, "time", NULL, 0, now.tv_sec);
+    write_line(fd, "pid", NULL, 0, getpid());
+    write_line(fd, "commands", NULL, 0, shell_stats.commands);
+    write_line(fd, "spawns", NULL, 0, shell_stats.spawns);
+    write_line(fd, "exec_failures", NULL, 0, shell_stats.exec_failures);
+    write_line(fd, "bg_launched", NULL, 0, shell_stats.bg_launched);
+    write_line(fd, "bg_reaped", NULL, 0, shell_stats.bg_reaped);
+    write_line(fd, "bg_peak", NULL, 0, (unsigned long)shell_stats.bg_peak);
+    write_histogram(fd, "spawn_us", shell_stats.spawn_us);
+    write_histogram(fd, "wait_us", shell_stats.wait_us);
+}
+
+void sigusr2_handler(int sig) {
+    int saved_errno = errno;
+
+    (void)sig;
+    write_shell_stats(STDERR_FILENO);
+    errno = saved_errno;
+}
+
+void handle_shstat_command(job_info* job) {
+    if (job->procs->argc > 1)
+        fprintf(stderr, "shstat: usage: shstat\n");
+    else {
+        fflush(stdout);
+        write_shell_stats(STDOUT_FILENO);
+    }
+    free_job(job);
+}
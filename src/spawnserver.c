@@ -0,0 +1,249 @@
+#define _GNU_SOURCE
+#include "spawnserver.h"
+
+#include <errno.h>
+#include <sched.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+
+/*
+ * Wire format of a request (one SOCK_SEQPACKET message):
+ *   spawn_request_t, then path and argv[] as consecutive NUL terminated strings.
+ * Ancillary data carries the cwd of the shell followed by the descriptors
+ * flagged in fd_mask (stdin, stdout, stderr in that order): rd's, or the
+ * shell's own where rd has none, since the server's stdio is the shell's
+ * at startup and the shell may have been redirected since (exec > file).
+ * The reply is a spawn_reply_t.
+ */
+typedef struct {
+	int argc;
+	int fd_mask;   // bit 0 stdin, bit 1 stdout, bit 2 stderr; bits 4-6 closed in the shell
+	pid_t pgid;    // process group to put the child in, -1 for none
+	size_t len;    // bytes of strings following the header
+} spawn_request_t;
+
+typedef struct {
+	pid_t pid;     // -1 on failure
+	int err;       // errno of the failed exec/clone
+} spawn_reply_t;
+
+#define MAX_PASSED_FDS 4
+
+static int server_sock = -1;
+static pid_t server_pid = -1;
+
+
+static void serve(int sock) __attribute__((noreturn));
+
+int start_spawn_server(void) {
+	int sv[2];
+
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) < 0)
+		return -1;
+
+	if ((server_pid = fork()) < 0) {
+		close(sv[0]);
+		close(sv[1]);
+		return -1;
+	}
+	if (server_pid == 0) {
+		close(sv[0]);
+		serve(sv[1]);
+	}
+	close(sv[1]);
+	server_sock = sv[0];
+	return 0;
+}
+
+bool spawn_server_running(void) {
+	return server_sock >= 0;
+}
+
+static void send_fds_msg(int sock, void* buf, size_t len, int* fds, int nfds) {
+	char control[CMSG_SPACE(sizeof(int) * MAX_PASSED_FDS)];
+	struct iovec iov = { buf, len };
+	struct msghdr msg = { 0 };
+
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	if (nfds > 0) {
+		struct cmsghdr* cmsg;
+		msg.msg_control = control;
+		msg.msg_controllen = CMSG_SPACE(sizeof(int) * nfds);
+		cmsg = CMSG_FIRSTHDR(&msg);
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SCM_RIGHTS;
+		cmsg->cmsg_len = CMSG_LEN(sizeof(int) * nfds);
+		memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * nfds);
+	}
+	while (sendmsg(sock, &msg, MSG_NOSIGNAL) < 0 && errno == EINTR)
+		;
+}
+
+pid_t spawn_server_launch(const char* path, char** argv, redir_t* rd, pid_t pgid) {
+	spawn_request_t* req;
+	spawn_reply_t reply;
+	int fds[MAX_PASSED_FDS];
+	int stdio[3];
+	int nfds = 0;
+	size_t len = strlen(path) + 1;
+	char* p;
+	int i;
+
+	for (i = 0; argv[i] != NULL; i++)
+		len += strlen(argv[i]) + 1;
+	if (sizeof(spawn_request_t) + len > SPAWN_SERVER_MAX_MSG) {
+		errno = ENOSPC;
+		return -1;
+	}
+
+	req = malloc(sizeof(spawn_request_t) + len);
+	req->argc = i;
+	req->len = len;
+	req->fd_mask = 0;
+	req->pgid = pgid;
+	p = (char*)(req + 1);
+	p = stpcpy(p, path) + 1;
+	for (i = 0; argv[i] != NULL; i++)
+		p = stpcpy(p, argv[i]) + 1;
+
+	// The server's cwd is wherever the shell started; send ours along
+	if ((fds[nfds++] = open(".", O_PATH | O_DIRECTORY | O_CLOEXEC)) < 0) {
+		free(req);
+		errno = EAGAIN;
+		return -1;
+	}
+	stdio[0] = rd->in_fd;
+	stdio[1] = rd->out_fd;
+	stdio[2] = rd->err_fd;
+	for (i = 0; i < 3; i++) {
+		int fd = stdio[i] >= 0 ? stdio[i] : i;
+		if (fcntl(fd, F_GETFD) < 0)
+			req->fd_mask |= 0x10 << i;
+		else {
+			req->fd_mask |= 1 << i;
+			fds[nfds++] = fd;
+		}
+	}
+
+	send_fds_msg(server_sock, req, sizeof(spawn_request_t) + len, fds, nfds);
+	close(fds[0]);
+	free(req);
+
+	if (recv(server_sock, &reply, sizeof(reply), 0) != sizeof(reply)) {
+		// The server is gone; from now on the shell launches processes itself
+		close(server_sock);
+		server_sock = -1;
+		errno = EAGAIN;
+		return -1;
+	}
+	if (reply.pid < 0)
+		errno = reply.err;
+	return reply.pid;
+}
+
+
+/*
+ * Runs in the server's child right before exec. Only async-signal-safe calls.
+ */
+static void exec_request(int cwd_fd, int* stdio, pid_t pgid, const char* path, char** argv, int err_pipe) {
+	int fd;
+
+	if (pgid >= 0 && setpgid(0, pgid) < 0)
+		goto fail;
+	if (cwd_fd >= 0 && fchdir(cwd_fd) < 0)
+		goto fail;
+	for (fd = 0; fd < 3; fd++) {
+		if (stdio[fd] >= 0 && dup2(stdio[fd], fd) < 0)
+			goto fail;
+		if (stdio[fd] == -2)
+			close(fd);
+	}
+	execv(path, argv);
+fail:
+	fd = errno;
+	write(err_pipe, &fd, sizeof(fd));
+	_exit(127);
+}
+
+static void serve(int sock) {
+	char* buf = malloc(SPAWN_SERVER_MAX_MSG);
+	char control[CMSG_SPACE(sizeof(int) * MAX_PASSED_FDS)];
+
+	for (;;) {
+		struct iovec iov = { buf, SPAWN_SERVER_MAX_MSG };
+		struct msghdr msg = { 0 };
+		struct cmsghdr* cmsg;
+		spawn_request_t* req = (spawn_request_t*)buf;
+		spawn_reply_t reply = { -1, 0 };
+		int fds[MAX_PASSED_FDS];
+		int stdio[3] = { -1, -1, -1 };
+		int nfds = 0;
+		int err_pipe[2];
+		char** argv;
+		char* p;
+		ssize_t n;
+		int i;
+
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof(control);
+		n = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+		if (n == 0)
+			_exit(EXIT_SUCCESS);  // the shell exited
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			_exit(EXIT_FAILURE);
+		}
+
+		for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+			if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+				nfds = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+				memcpy(fds, CMSG_DATA(cmsg), nfds * sizeof(int));
+			}
+		}
+		for (i = 0, n = 1; i < 3; i++) {
+			if (req->fd_mask & (1 << i))
+				stdio[i] = n < nfds ? fds[n++] : -1;
+			else if (req->fd_mask & (0x10 << i))
+				stdio[i] = -2;  // closed in the shell
+		}
+
+		argv = malloc((req->argc + 1) * sizeof(char*));
+		p = (char*)(req + 1);
+		char* path = p;
+		p += strlen(p) + 1;
+		for (i = 0; i < req->argc; i++) {
+			argv[i] = p;
+			p += strlen(p) + 1;
+		}
+		argv[i] = NULL;
+
+		// A CLOEXEC pipe tells us whether exec succeeded: EOF means it did
+		if (pipe2(err_pipe, O_CLOEXEC) < 0) {
+			reply.err = errno;
+		}
+		else {
+			// CLONE_PARENT makes the new process a child of the shell, not ours
+			pid_t pid = syscall(SYS_clone, CLONE_PARENT | SIGCHLD, 0, NULL, NULL, 0);
+			if (pid == 0)
+				exec_request(nfds > 0 ? fds[0] : -1, stdio, req->pgid, path, argv, err_pipe[1]);
+			close(err_pipe[1]);
+			if (pid < 0)
+				reply.err = errno;
+			else if (read(err_pipe[0], &reply.err, sizeof(reply.err)) == sizeof(reply.err))
+				reply.pid = -1;  // it exits and the shell reaps it
+			else
+				reply.pid = pid;
+			close(err_pipe[0]);
+		}
+
+		for (i = 0; i < nfds; i++)
+			close(fds[i]);
+		free(argv);
+		while (send(sock, &reply, sizeof(reply), MSG_NOSIGNAL) < 0 && errno == EINTR)
+			;
+	}
+}
@@ -0,0 +1,176 @@
+#include "throttle.h"
+#include "events.h"
+
+#include <signal.h>
+#include <string.h>
+
+#define THROTTLE_USAGE "throttle: usage: throttle [-c cpu%] [-m mem%] [-l load] [-i ms] | throttle off\n"
+
+typedef enum {
+    PRESSURE_LOW,   // jobs may be resumed
+    PRESSURE_OK,
+    PRESSURE_HIGH,  // jobs have to be stopped
+} pressure_t;
+
+static struct {
+    bool on;
+    double cpu_max;
+    double mem_max;
+    double load_max;
+    long interval_ms;
+    shell_timer_t* timer;
+    job_table_t* table;
+} throttle = { false, THROTTLE_CPU_PCT, THROTTLE_MEM_PCT, 0, THROTTLE_INTERVAL_MS, NULL, NULL };
+
+
+// Reads the avg10 of the "some" line of a PSI file
+static bool read_psi(const char* path, double* avg10) {
+    FILE* fp = fopen(path, "re");
+    bool ok;
+
+    if (fp == NULL)
+        return false;
+    ok = fscanf(fp, "some avg10=%lf", avg10) == 1;
+    fclose(fp);
+    return ok;
+}
+
+static bool read_loadavg(double* load) {
+    FILE* fp = fopen("/proc/loadavg", "re");
+    bool ok;
+
+    if (fp == NULL)
+        return false;
+    ok = fscanf(fp, "%lf", load) == 1;
+    fclose(fp);
+    return ok;
+}
+
+static pressure_t sample_pressure(void) {
+    double cpu, mem = 0, load;
+
+    if (read_psi("/proc/pressure/cpu", &cpu)) {
+        read_psi("/proc/pressure/memory", &mem);
+        if (cpu > throttle.cpu_max || mem > throttle.mem_max)
+            return PRESSURE_HIGH;
+        if (cpu < throttle.cpu_max * THROTTLE_RESUME_FRACTION &&
+            mem < throttle.mem_max * THROTTLE_RESUME_FRACTION)
+            return PRESSURE_LOW;
+        return PRESSURE_OK;
+    }
+    if (read_loadavg(&load)) {
+        if (load > throttle.load_max)
+            return PRESSURE_HIGH;
+        if (load < throttle.load_max * THROTTLE_RESUME_FRACTION)
+            return PRESSURE_LOW;
+    }
+    return PRESSURE_OK;
+}
+
+static void set_throttled(bgentry_t* entry, bool stop) {
+    // The whole process group, so every stage of a pipeline stops with it
+    kill(-entry->pid, stop ? SIGSTOP : SIGCONT);
+    entry->throttled = stop;
+}
+
+static void throttle_tick(void* arg) {
+    pressure_t pressure = sample_pressure();
+    node_t* node;
+
+    if (pressure == PRESSURE_HIGH) {
+        // Newest first: the jobs started last have done the least work
+        for (node = throttle.table->jobs->head; node != NULL; node = node->next)
+            if (!((bgentry_t*)node->data)->throttled) {
+                set_throttled(node->data, true);
+                break;
+            }
+    }
+    else if (pressure == PRESSURE_LOW) {
+        for (node = throttle.table->jobs->tail; node != NULL; node = node->prev)
+            if (((bgentry_t*)node->data)->throttled) {
+                set_throttled(node->data, false);
+                break;
+            }
+    }
+    throttle.timer = add_timer(throttle.interval_ms, throttle_tick, NULL);
+}
+
+static void print_throttle(job_table_t* bg_job_list) {
+    int stopped = 0;
+    node_t* node;
+    double unused;
+
+    if (!throttle.on) {
+        printf("throttle: off\n");
+        return;
+    }
+    for (node = bg_job_list->jobs->head; node != NULL; node = node->next)
+        if (((bgentry_t*)node->data)->throttled)
+            stopped++;
+    if (read_psi("/proc/pressure/cpu", &unused))
+        printf("throttle: psi cpu %.1f%% mem %.1f%%", throttle.cpu_max, throttle.mem_max);
+    else
+        printf("throttle: loadavg %.2f", throttle.load_max);
+    printf(" every %ldms, %d stopped\n", throttle.interval_ms, stopped);
+}
+
+void handle_throttle_command(job_info* job, job_table_t* bg_job_list) {
+    proc_info* proc = job->procs;
+    node_t* node;
+    int i;
+
+    throttle.table = bg_job_list;
+    if (throttle.load_max == 0)
+        throttle.load_max = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (proc->argc == 1) {
+        print_throttle(bg_job_list);
+        free_job(job);
+        return;
+    }
+
+    if (proc->argc == 2 && strcmp(proc->argv[1], "off") == 0) {
+        if (throttle.timer != NULL)
+            cancel_timer(throttle.timer);
+        throttle.timer = NULL;
+        throttle.on = false;
+        for (node = bg_job_list->jobs->head; node != NULL; node = node->next)
+            if (((bgentry_t*)node->data)->throttled)
+                set_throttled(node->data, false);
+        free_job(job);
+        return;
+    }
+
+    for (i = 1; i + 1 < proc->argc; i += 2) {
+        double value = atof(proc->argv[i + 1]);
+        if (value <= 0)
+            break;
+        if (strcmp(proc->argv[i], "-c") == 0)
+            throttle.cpu_max = value;
+        else if (strcmp(proc->argv[i], "-m") == 0)
+            throttle.mem_max = value;
+        else if (strcmp(proc->argv[i], "-l") == 0)
+            throttle.load_max = value;
+        else if (strcmp(proc->argv[i], "-i") == 0)
+            throttle.interval_ms = value;
+        else
+            break;
+    }
+    if (i != proc->argc) {
+        fputs(THROTTLE_USAGE, stderr);
+        free_job(job);
+        return;
+    }
+
+    // New settings take effect with a fresh sample
+    if (throttle.timer != NULL)
+        cancel_timer(throttle.timer);
+    throttle.on = true;
+    throttle.timer = add_timer(throttle.interval_ms, throttle_tick, NULL);
+    free_job(job);
+}
+
+void unthrottle_job(bgentry_t* entry) {
+    if (entry->throttled)
+        set_throttled(entry, false);
+}
@@ -0,0 +1,164 @@
+#include "timeout.h"
+#include "events.h"
+#include "helpers.h"
+
+#include <math.h>
+#include <signal.h>
+#include <string.h>
+
+struct job_timeout {
+    pid_t* pids;
+    int n;
+    pid_t pgid;       // signalled as a group if positive
+    long grace_ms;
+    bool expired;     // SIGTERM has been sent
+    shell_timer_t* timer;
+};
+
+long job_timeout_ms = 0;
+long job_grace_ms = TIMEOUT_GRACE_MS;
+
+static long default_timeout_ms = 0;
+static long default_grace_ms = TIMEOUT_GRACE_MS;
+
+
+// Parses "1.5", "30s", "500ms", "2m" or "1h" into milliseconds
+static bool parse_duration(const char* s, long* ms) {
+    char* end;
+    double value = strtod(s, &end);
+    double scale;
+
+    if (end == s || value < 0 || !isfinite(value))
+        return false;
+    if (*end == '\0' || strcmp(end, "s") == 0)
+        scale = 1000;
+    else if (strcmp(end, "ms") == 0)
+        scale = 1;
+    else if (strcmp(end, "m") == 0)
+        scale = 60 * 1000;
+    else if (strcmp(end, "h") == 0)
+        scale = 60 * 60 * 1000;
+    else
+        return false;
+    *ms = value * scale;
+    return true;
+}
+
+bool take_job_timeout(job_info* job, int* last_child_status) {
+    proc_info* proc = job->procs;
+    long grace = default_grace_ms;
+    long limit = -1;
+    bool set_default = false;
+    int i;
+
+    job_timeout_ms = default_timeout_ms;
+    job_grace_ms = default_grace_ms;
+    if (strcmp(proc->cmd, "timeout") != 0)
+        return true;
+
+    if (proc->argc == 1) {
+        if (default_timeout_ms == 0)
+            printf("timeout: no default\n");
+        else
+            printf("timeout: default %.3fs, grace %.3fs\n", default_timeout_ms / 1000.0, default_grace_ms / 1000.0);
+        free_job(job);
+        return false;
+    }
+
+    for (i = 1; i < proc->argc; i++) {
+        if (strcmp(proc->argv[i], "-k") == 0 && i + 1 < proc->argc) {
+            if (!parse_duration(proc->argv[++i], &grace))
+                break;
+        }
+        else if (strcmp(proc->argv[i], "-d") == 0 && i + 1 < proc->argc) {
+            if (!parse_duration(proc->argv[++i], &limit))
+                break;
+            set_default = true;
+        }
+        else if (!set_default && limit < 0 && parse_duration(proc->argv[i], &limit)) {
+            i++;
+            break;
+        }
+        else
+            break;
+    }
+
+    if (set_default && i == proc->argc) {
+        default_timeout_ms = limit;
+        default_grace_ms = grace;
+        *last_child_status = 0;
+        free_job(job);
+        return false;
+    }
+    if (set_default || limit < 0 || i == proc->argc) {
+        fprintf(stderr, TIMEOUT_USAGE);
+        *last_child_status = 2;
+        free_job(job);
+        return false;
+    }
+
+    shift_words(proc, i);
+    job_timeout_ms = limit;
+    job_grace_ms = grace;
+    return true;
+}
+
+static void signal_job(job_timeout_t* t, int sig) {
+    int i;
+
+    if (t->pgid > 0) {
+        kill(-t->pgid, sig);
+        return;
+    }
+    for (i = 0; i < t->n; i++)
+        if (t->pids[i] > 0)
+            kill(t->pids[i], sig);
+}
+
+static void kill_job(void* arg) {
+    job_timeout_t* t = arg;
+
+    t->timer = NULL;
+    signal_job(t, SIGKILL);
+}
+
+static void expire_job(void* arg) {
+    job_timeout_t* t = arg;
+
+    t->expired = true;
+    signal_job(t, SIGTERM);
+    // A stopped job only sees the SIGTERM once it runs again
+    signal_job(t, SIGCONT);
+    t->timer = add_timer(t->grace_ms, kill_job, t);
+}
+
+job_timeout_t* start_job_timeout(pid_t* pids, int n, pid_t pgid) {
+    job_timeout_t* t;
+
+    if (job_timeout_ms == 0)
+        return NULL;
+    t = malloc(sizeof(job_timeout_t));
+    t->pids = pids;
+    t->n = n;
+    t->pgid = pgid;
+    t->grace_ms = job_grace_ms;
+    t->expired = false;
+    t->timer = add_timer(job_timeout_ms, expire_job, t);
+    return t;
+}
+
+bool stop_job_timeout(job_timeout_t* t) {
+    bool expired;
+
+    if (t == NULL)
+        return false;
+    if (t->timer != NULL)
+        cancel_timer(t->timer);
+    expired = t->expired;
+    free(t);
+    return expired;
+}
+
+bool job_timed_out(job_timeout_t* t) {
+    return t != NULL && t->expired;
+}
@@ -0,0 +1,122 @@
+#include "trace.h"
+
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+
+#define TRACE_EVENT "%s{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d,\"args\":{\"arg\":%ld}}"
+
+typedef struct {
+    const char* name;
+    uint64_t start;   // ns
+    uint64_t dur;     // ns
+    long arg;
+    uint64_t seq;     // number of the event + 1 once complete, 0 while written
+} trace_event_t;
+
+bool tracing = false;
+
+static trace_event_t* ring = NULL;
+static uint64_t recorded = 0;      // events ever recorded; the next one's number
+static char* trace_path = NULL;
+
+
+uint64_t trace_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void trace_record(const char* name, uint64_t start, long arg) {
+    uint64_t end = trace_now();
+    uint64_t n = __atomic_fetch_add(&recorded, 1, __ATOMIC_RELAXED);
+    trace_event_t* event = &ring[n % TRACE_RING_EVENTS];
+
+    // A reader skips the slot until seq says it is whole again
+    __atomic_store_n(&event->seq, 0, __ATOMIC_RELAXED);
+    event->name = name;
+    event->start = start;
+    event->dur = end - start;
+    event->arg = arg;
+    __atomic_store_n(&event->seq, n + 1, __ATOMIC_RELEASE);
+}
+
+int start_tracing(const char* path) {
+#ifdef NO_TRACE
+    (void)path;
+    return -1;
+#else
+    if (ring == NULL)
+        ring = calloc(TRACE_RING_EVENTS, sizeof(trace_event_t));
+    if (path != NULL) {
+        free(trace_path);
+        trace_path = strdup(path);
+    }
+    tracing = true;
+    return 0;
+#endif
+}
+
+int flush_trace(const char* path) {
+    uint64_t end = __atomic_load_n(&recorded, __ATOMIC_ACQUIRE);
+    uint64_t n = end > TRACE_RING_EVENTS ? end - TRACE_RING_EVENTS : 0;
+    const char* sep = "";
+    pid_t pid = getpid();
+    FILE* fp;
+
+    if (path == NULL)
+        path = trace_path;
+    if (path == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+    if ((fp = fopen(path, "we")) == NULL)
+        return -1;
+
+    fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    for (; ring != NULL && n < end; n++) {
+        trace_event_t* event = &ring[n % TRACE_RING_EVENTS];
+        if (__atomic_load_n(&event->seq, __ATOMIC_ACQUIRE) != n + 1)
+            continue;  // overwritten or still being written
+        fprintf(fp, TRACE_EVENT, sep, event->name, event->start / 1e3, event->dur / 1e3, pid, pid, event->arg);
+        sep = ",\n";
+    }
+    fprintf(fp, "\n]}\n");
+    return fclose(fp) == 0 ? 0 : -1;
+}
+
+void finish_tracing(void) {
+    if (ring != NULL && trace_path != NULL && flush_trace(NULL) < 0)
+        perror(trace_path);
+}
+
+void handle_trace_command(job_info* job) {
+    proc_info* proc = job->procs;
+    char* arg = proc->argc > 2 ? proc->argv[2] : NULL;
+
+    if (proc->argc == 1) {
+        uint64_t n = __atomic_load_n(&recorded, __ATOMIC_RELAXED);
+        printf("trace: %s, %lu events held%s%s\n", tracing ? "on" : "off",
+               (unsigned long)(n < TRACE_RING_EVENTS ? n : TRACE_RING_EVENTS),
+               trace_path != NULL ? ", writes to " : "", trace_path != NULL ? trace_path : "");
+    }
+    else if (proc->argc > 3)
+        fprintf(stderr, TRACE_USAGE);
+    else if (strcmp(proc->argv[1], "on") == 0) {
+        if (start_tracing(arg) < 0)
+            fprintf(stderr, "trace: not compiled in\n");
+    }
+    else if (strcmp(proc->argv[1], "off") == 0 && arg == NULL)
+        tracing = false;
+    else if (strcmp(proc->argv[1], "flush") == 0) {
+        if (flush_trace(arg) < 0) {
+            if (arg == NULL && trace_path == NULL)
+                fprintf(stderr, TRACE_USAGE);
+            else
+                perror(arg != NULL ? arg : trace_path);
+        }
+    }
+    else
+        fprintf(stderr, TRACE_USAGE);
+    free_job(job);
+}
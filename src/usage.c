@@ -0,0 +1,130 @@
+#include "usage.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Columns of bglist -t: start, pid, state, elapsed, cpu, max rss, command
+#define USAGE_ENTRY "%lu\t%d\t%s\t%.3fs\t%.3fs\t%ldKiB\t%s\n"
+
+typedef struct {
+	char* line;
+	pid_t pid;
+	time_t seconds;
+	int status;
+	bool timed_out;
+	job_usage_t usage;
+} finished_job_t;
+
+job_usage_t fg_usage;
+
+static finished_job_t finished[FINISHED_JOBS_KEPT];
+static int finished_next = 0;  // slot the next finished job goes to
+static int finished_count = 0;
+
+
+static double timeval_seconds(const struct timeval* tv) {
+	return tv->tv_sec + tv->tv_usec / 1e6;
+}
+
+static double timespec_diff(const struct timespec* from, const struct timespec* to) {
+	return (to->tv_sec - from->tv_sec) + (to->tv_nsec - from->tv_nsec) / 1e9;
+}
+
+void usage_start(job_usage_t* usage) {
+	memset(usage, 0, sizeof(job_usage_t));
+	clock_gettime(CLOCK_MONOTONIC, &usage->start);
+}
+
+void usage_add(job_usage_t* usage, const struct rusage* ru) {
+	if (usage == NULL)
+		return;
+	usage->user += timeval_seconds(&ru->ru_utime);
+	usage->sys += timeval_seconds(&ru->ru_stime);
+	if (ru->ru_maxrss > usage->maxrss)
+		usage->maxrss = ru->ru_maxrss;
+	usage->nvcsw += ru->ru_nvcsw;
+	usage->nivcsw += ru->ru_nivcsw;
+}
+
+void usage_end(job_usage_t* usage) {
+	clock_gettime(CLOCK_MONOTONIC, &usage->end);
+}
+
+double usage_elapsed(const job_usage_t* usage) {
+	struct timespec now;
+
+	if (usage->end.tv_sec != 0 || usage->end.tv_nsec != 0)
+		return timespec_diff(&usage->start, &usage->end);
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return timespec_diff(&usage->start, &now);
+}
+
+double live_cpu_seconds(const pid_t* pids, int n) {
+	long ticks = sysconf(_SC_CLK_TCK);
+	unsigned long utime, stime;
+	double total = 0;
+	char path[32];
+	char buf[512];
+	char* p;
+	FILE* fp;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		if (pids[i] <= 0)
+			continue;
+		snprintf(path, sizeof(path), "/proc/%d/stat", pids[i]);
+		if ((fp = fopen(path, "re")) == NULL)
+			continue;
+		// The command name may hold spaces; the fields start after its last ')'
+		if (fgets(buf, sizeof(buf), fp) != NULL && (p = strrchr(buf, ')')) != NULL &&
+		    sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &utime, &stime) == 2)
+			total += (double)(utime + stime) / ticks;
+		fclose(fp);
+	}
+	return total;
+}
+
+void print_time_report(FILE* fp, const job_usage_t* usage) {
+	fprintf(fp, "real\t%.3fs\nuser\t%.3fs\nsys\t%.3fs\nmaxrss\t%ldKiB\nctxsw\t%ld voluntary, %ld involuntary\n",
+	        usage_elapsed(usage), usage->user, usage->sys, usage->maxrss, usage->nvcsw, usage->nivcsw);
+}
+
+void record_finished_job(const char* line, pid_t pid, time_t seconds, int status, bool timed_out,
+                         const job_usage_t* usage) {
+	finished_job_t* job = &finished[finished_next];
+
+	if (finished_count == FINISHED_JOBS_KEPT)
+		free(job->line);
+	else
+		finished_count++;
+	job->line = strdup(line);
+	job->pid = pid;
+	job->seconds = seconds;
+	job->status = status;
+	job->timed_out = timed_out;
+	job->usage = *usage;
+	finished_next = (finished_next + 1) % FINISHED_JOBS_KEPT;
+}
+
+void print_usage_entry(FILE* fp, time_t seconds, pid_t pid, const char* state, double cpu,
+                       const job_usage_t* usage, const char* line) {
+	fprintf(fp, USAGE_ENTRY, (unsigned long)seconds, pid, state, usage_elapsed(usage), cpu, usage->maxrss, line);
+}
+
+void print_finished_jobs(FILE* fp) {
+	char state[32];
+	int i;
+
+	for (i = 1; i <= finished_count; i++) {
+		finished_job_t* job = &finished[(finished_next - i + FINISHED_JOBS_KEPT) % FINISHED_JOBS_KEPT];
+		if (job->timed_out)
+			strcpy(state, "timeout");
+		else if (WIFSIGNALED(job->status))
+			snprintf(state, sizeof(state), "killed %d", WTERMSIG(job->status));
+		else
+			snprintf(state, sizeof(state), "done %d", WEXITSTATUS(job->status));
+		print_usage_entry(fp, job->seconds, job->pid, state, job->usage.user + job->usage.sys, &job->usage, job->line);
+	}
+}
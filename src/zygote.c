@@ -0,0 +1,229 @@
+#define _GNU_SOURCE
+#include "zygote.h"
+
+#include <errno.h>
+#include <spawn.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+
+extern char** environ;
+
+/*
+ * The zygote itself. argv[1] is its end of the socketpair.
+ * A request is one message: a byte with the stdio mask (bit 0 stdin, bit 1
+ * stdout, bit 2 stderr; bits 4-6 for ones closed in the shell), the process
+ * group as a native int (-1 for none) and the script's argv as NUL terminated
+ * strings. SCM_RIGHTS carries the shell's cwd and then the masked descriptors.
+ * The reply is the pid and errno packed like zygote_reply_t.
+ * Children are double forked so they are reparented to the shell (a subreaper);
+ * the reply is only sent once that has happened.
+ */
+static const char* zygote_source =
+	"import os, sys, socket, struct, array, runpy, traceback\n"
+	"import argparse, subprocess, time\n"
+	"sock = socket.socket(fileno=int(sys.argv[1]))\n"
+	"def run(fds, mask, pgid, argv):\n"
+	"    if pgid >= 0:\n"
+	"        os.setpgid(0, pgid)\n"
+	"    os.fchdir(fds[0])\n"
+	"    n = 1\n"
+	"    for target in range(3):\n"
+	"        if mask & (1 << target):\n"
+	"            os.dup2(fds[n], target)\n"
+	"            n += 1\n"
+	"        elif mask & (0x10 << target):\n"
+	"            os.close(target)\n"
+	"    os.closerange(3, os.sysconf('SC_OPEN_MAX'))\n"
+	"    sys.argv = argv\n"
+	"    sys.path[0] = os.path.dirname(os.path.abspath(argv[0]))\n"
+	"    code = 0\n"
+	"    try:\n"
+	"        if not os.path.isfile(argv[0]):\n"
+	"            sys.stderr.write(\"python3: can't open file '%s': [Errno 2] No such file or directory\\n\" % os.path.abspath(argv[0]))\n"
+	"            code = 2\n"
+	"        else:\n"
+	"            runpy.run_path(argv[0], run_name='__main__')\n"
+	"    except SystemExit as e:\n"
+	"        code = e.code\n"
+	"        if code is None:\n"
+	"            code = 0\n"
+	"        elif not isinstance(code, int):\n"
+	"            sys.stderr.write('%s\\n' % code)\n"
+	"            code = 1\n"
+	"    except BaseException:\n"
+	"        traceback.print_exc()\n"
+	"        code = 1\n"
+	"    try:\n"
+	"        sys.stdout.flush()\n"
+	"        sys.stderr.flush()\n"
+	"    except BaseException:\n"
+	"        pass\n"
+	"    os._exit(code & 0xff)\n"
+	"while True:\n"
+	"    try:\n"
+	"        data, anc, flags, addr = sock.recvmsg(65536, socket.CMSG_SPACE(4 * 4))\n"
+	"    except InterruptedError:\n"
+	"        continue\n"
+	"    if not data:\n"
+	"        break\n"
+	"    fds = array.array('i')\n"
+	"    for level, kind, cdata in anc:\n"
+	"        if level == socket.SOL_SOCKET and kind == socket.SCM_RIGHTS:\n"
+	"            fds.frombytes(cdata[:len(cdata) - len(cdata) % fds.itemsize])\n"
+	"    pgid = struct.unpack_from('i', data, 1)[0]\n"
+	"    argv = [a.decode('utf-8', 'surrogateescape') for a in data[5:].split(b'\\0')[:-1]]\n"
+	"    r, w = os.pipe()\n"
+	"    pid = os.fork()\n"
+	"    if pid == 0:\n"
+	"        os.close(r)\n"
+	"        worker = os.fork()\n"
+	"        if worker == 0:\n"
+	"            os.close(w)\n"
+	"            run(fds, data[0], pgid, argv)\n"
+	"        os.write(w, struct.pack('i', worker))\n"
+	"        os._exit(0)\n"
+	"    os.close(w)\n"
+	"    reply = os.read(r, 4)\n"
+	"    os.close(r)\n"
+	"    os.waitpid(pid, 0)\n"
+	"    for fd in fds:\n"
+	"        os.close(fd)\n"
+	"    if len(reply) == 4:\n"
+	"        sock.send(struct.pack('ii', struct.unpack('i', reply)[0], 0))\n"
+	"    else:\n"
+	"        sock.send(struct.pack('ii', -1, 11))\n";
+
+typedef struct {
+	pid_t pid;   // -1 on failure
+	int err;     // errno of the failure
+} zygote_reply_t;
+
+#define ZYGOTE_MAX_FDS 4
+
+static int zygote_sock = -1;
+static char* zygote_interpreter = NULL;
+
+
+int start_python_zygote(const char* interpreter) {
+	char fd_arg[16];
+	char* argv[5];
+	pid_t pid;
+	int sv[2];
+
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv) < 0)
+		return -1;
+	fcntl(sv[0], F_SETFD, FD_CLOEXEC);
+
+	snprintf(fd_arg, sizeof(fd_arg), "%d", sv[1]);
+	argv[0] = (char*)interpreter;
+	argv[1] = "-c";
+	argv[2] = (char*)zygote_source;
+	argv[3] = fd_arg;
+	argv[4] = NULL;
+	if ((errno = posix_spawnp(&pid, interpreter, NULL, NULL, argv, environ)) != 0) {
+		close(sv[0]);
+		close(sv[1]);
+		return -1;
+	}
+	close(sv[1]);
+
+	// Script children are double forked by the zygote and must end up with us
+	if (prctl(PR_SET_CHILD_SUBREAPER, 1) < 0) {
+		close(sv[0]);
+		return -1;
+	}
+	zygote_sock = sv[0];
+	zygote_interpreter = strdup(interpreter);
+	return 0;
+}
+
+bool zygote_accepts(proc_info* proc) {
+	const char* script;
+	size_t len;
+
+	if (zygote_sock < 0 || proc->argc < 2 || strcmp(proc->cmd, zygote_interpreter) != 0)
+		return false;
+	// Only plain "python3 script.py ..." runs; interpreter options change too much
+	script = proc->argv[1];
+	len = strlen(script);
+	return script[0] != '-' && len > 3 && strcmp(script + len - 3, ".py") == 0;
+}
+
+pid_t zygote_launch(proc_info* proc, redir_t* rd, pid_t pgid) {
+	char control[CMSG_SPACE(sizeof(int) * ZYGOTE_MAX_FDS)];
+	struct msghdr msg = { 0 };
+	struct cmsghdr* cmsg;
+	struct iovec iov;
+	zygote_reply_t reply;
+	int fds[ZYGOTE_MAX_FDS];
+	int stdio[3];
+	int nfds = 0;
+	size_t len = 1 + sizeof(int);
+	int group = pgid;
+	char* buf;
+	char* p;
+	int i;
+
+	for (i = 1; i < proc->argc; i++)
+		len += strlen(proc->argv[i]) + 1;
+	if (len > ZYGOTE_MAX_MSG) {
+		errno = EAGAIN;
+		return -1;
+	}
+
+	// The zygote's cwd is wherever the shell started; send ours along
+	if ((fds[nfds++] = open(".", O_PATH | O_DIRECTORY | O_CLOEXEC)) < 0) {
+		errno = EAGAIN;
+		return -1;
+	}
+
+	// Where rd has no descriptor the child gets the shell's own, not the
+	// zygote's: the shell may have been redirected since it started
+	buf = malloc(len);
+	buf[0] = 0;
+	stdio[0] = rd->in_fd;
+	stdio[1] = rd->out_fd;
+	stdio[2] = rd->err_fd;
+	for (i = 0; i < 3; i++) {
+		int fd = stdio[i] >= 0 ? stdio[i] : i;
+		if (fcntl(fd, F_GETFD) < 0)
+			buf[0] |= 0x10 << i;
+		else {
+			buf[0] |= 1 << i;
+			fds[nfds++] = fd;
+		}
+	}
+	memcpy(buf + 1, &group, sizeof(int));
+	for (i = 1, p = buf + 1 + sizeof(int); i < proc->argc; i++)
+		p = stpcpy(p, proc->argv[i]) + 1;
+
+	iov.iov_base = buf;
+	iov.iov_len = len;
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = CMSG_SPACE(sizeof(int) * nfds);
+	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(int) * nfds);
+	memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * nfds);
+
+	while (sendmsg(zygote_sock, &msg, MSG_NOSIGNAL) < 0 && errno == EINTR)
+		;
+	close(fds[0]);
+	free(buf);
+
+	if (recv(zygote_sock, &reply, sizeof(reply), 0) != sizeof(reply)) {
+		// The zygote died; scripts run the normal way from now on
+		close(zygote_sock);
+		zygote_sock = -1;
+		errno = EAGAIN;
+		return -1;
+	}
+	if (reply.pid < 0) {
+		errno = EAGAIN;
+		return -1;
+	}
+	return reply.pid;
+}
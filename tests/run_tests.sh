@@ -0,0 +1,110 @@
+#!/bin/sh
+# Runs the shell on small command lines and checks what it prints.
+# Usage: tests/run_tests.sh [shell], from the top of the tree (make test)
+
+SHELL_BIN=${1:-./bin/53shell}
+failed=0
+
+# Scratch files of the tests
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+
+# report name status: prints the result of a test that is done with status
+report() {
+    if [ "$2" -eq 0 ]; then
+        echo "ok   $1"
+    else
+        echo "FAIL $1"
+        failed=1
+    fi
+}
+
+# expect_stderr name pattern command: the shell run with -c command must
+# print a line matching pattern to stderr
+expect_stderr() {
+    if "$SHELL_BIN" -c "$3" 2>&1 >/dev/null | grep -q "$2"; then
+        echo "ok   $1"
+    else
+        echo "FAIL $1"
+        failed=1
+    fi
+}
+
+# expect_stdout name expected command: what the shell run with -c command prints
+expect_stdout() {
+    if [ "$("$SHELL_BIN" -c "$3" 2>/dev/null)" = "$2" ]; then
+        echo "ok   $1"
+    else
+        echo "FAIL $1"
+        failed=1
+    fi
+}
+
+expect_stdout "redirected group" after '(echo g1; echo g2) > /dev/null; echo after'
+
+# An executable without #! runs with /bin/sh, like execvp does it
+printf 'echo script "$@"\n' > "$tmp/nosheb.sh"
+chmod +x "$tmp/nosheb.sh"
+expect_stdout "script without #!" "script a" "$tmp/nosheb.sh a; echo"
+expect_stdout "script without #! in a pipeline" "script b" "$tmp/nosheb.sh b | cat"
+expect_stdout "script without #! with run limits" "script c" "run --nice 1 $tmp/nosheb.sh c"
+expect_stdout "script without #! as the last command" "script d" "$tmp/nosheb.sh d"
+out=$(ICSSH_SPAWN_SERVER=1 "$SHELL_BIN" -c "$tmp/nosheb.sh e; echo" 2>/dev/null)
+[ "$out" = "script e" ]
+report "script without #! through the spawn server" $?
+
+# Processes from the spawn server write to where the shell's stdout is now
+ICSSH_SPAWN_SERVER=1 "$SHELL_BIN" -c "exec > $tmp/srv.out; /bin/echo hi; (/bin/echo g) > $tmp/srv2.out; true" >/dev/null
+[ "$(cat "$tmp/srv.out" "$tmp/srv2.out")" = "$(printf 'hi\ng')" ]
+report "spawn server follows the shell's redirected stdout" $?
+
+# So do script runs served by the Python zygote
+if command -v python3 >/dev/null; then
+    printf 'print("py")\n' > "$tmp/z.py"
+    ICSSH_PYTHON_ZYGOTE=1 "$SHELL_BIN" -c "exec > $tmp/zyg.out; python3 $tmp/z.py; (python3 $tmp/z.py) > $tmp/zyg2.out; true" >/dev/null
+    [ "$(cat "$tmp/zyg.out" "$tmp/zyg2.out")" = "$(printf 'py\npy')" ]
+    report "zygote follows the shell's redirected stdout" $?
+fi
+
+# parallel's items on a piped script are the rest of the script
+[ "$(printf 'parallel -k -j 2 /bin/echo\nline-a\nline-b\n' | "$SHELL_BIN" 2>&1)" = "$(printf 'line-a\nline-b')" ]
+report "parallel items from a script on stdin" $?
+
+# The builtins, with estatus for their exit status
+expect_stdout "echo" "a b" 'echo a  b'
+expect_stdout "echo -n" "ab" 'echo -n a; echo b'
+expect_stdout "true" 0 'true; estatus'
+expect_stdout "false" 1 'false; estatus'
+expect_stdout "printf conversions" "42| 3.14|ff" "printf '%d|%5.2f|%x' 42 3.14159 255"
+expect_stdout "printf reuses its format for extra arguments" "a.b.c." "printf '%s.' a b c"
+expect_stdout "printf with too few arguments" "a-.0." "printf '%s-%s.%d.' a"
+expect_stdout "printf with a bad number" "01" "printf '%d' abc; estatus"
+expect_stdout "printf without a format" 1 'printf; estatus'
+expect_stdout "test true" 0 'test 1 -eq 1; estatus'
+expect_stdout "test false" 1 'test 1 -gt 2; estatus'
+expect_stdout "test with no arguments" 1 'test; estatus'
+expect_stdout "test with a bad integer" 2 'test 1 -eq x; estatus'
+expect_stdout "[ ]" 0 '[ -n x -a ! -z x ]; estatus'
+expect_stdout "[ ] false" 1 '[ a = b ]; estatus'
+expect_stdout "[ without ]" 2 '[ a = a; estatus'
+expect_stderr "[ without ] says so" "missing ']'" '[ a = a'
+expect_stdout "pwd" "$(pwd)" 'pwd'
+# cd prints where it went, pwd then prints it again
+expect_stdout "pwd after cd" "$(printf '/\n/')" 'cd /; pwd'
+
+expect_stderr "time reports with -c" '^real' 'time sleep 0.1'
+expect_stderr "time reports after a list" '^real' 'true; time sleep 0.1'
+
+# The trace is written even when the last command replaces the shell
+trace=$(mktemp)
+rm -f "$trace"
+ICSSH_TRACE=$trace "$SHELL_BIN" -c 'echo hi; sleep 0.1' >/dev/null
+if [ -s "$trace" ]; then
+    echo "ok   trace written before a tail exec"
+else
+    echo "FAIL trace written before a tail exec"
+    failed=1
+fi
+rm -f "$trace"
+
+exit $failed
@@ -0,0 +1,252 @@
+/*
+ * Checks the job table, the linked list and the object pool directly.
+ * Built and run by make test, with and without pools.
+ */
+#include "jobtable.h"
+#include "linkedlist.h"
+#include "pool.h"
+
+#include <string.h>
+
+static int failed = 0;
+
+// Prints the result of a test, like tests/run_tests.sh
+static void report(const char* name, int ok) {
+    printf("%s %s\n", ok ? "ok  " : "FAIL", name);
+    if (!ok)
+        failed = 1;
+}
+
+// A job of npids processes with consecutive pids; first is its leader
+static bgentry_t* make_entry(pid_t first, int npids) {
+    bgentry_t* entry = calloc(1, sizeof(bgentry_t));
+    int k;
+
+    entry->pids = malloc(npids * sizeof(pid_t));
+    for (k = 0; k < npids; k++)
+        entry->pids[k] = first + k;
+    entry->npids = npids;
+    entry->nlive = npids;
+    entry->pid = first;
+    return entry;
+}
+
+static void free_entry(bgentry_t* entry) {
+    free(entry->pids);
+    free(entry);
+}
+
+// The recency list agrees with itself walked both ways
+static int links_consistent(list_t* list) {
+    node_t* node;
+    node_t* prev = NULL;
+    int n = 0;
+
+    for (node = list->head; node != NULL; prev = node, node = node->next) {
+        if (node->prev != prev)
+            return 0;
+        n++;
+    }
+    return list->tail == prev && list->length == n;
+}
+
+static void test_rehash(void) {
+    job_table_t* table = create_job_table();
+    bgentry_t* entries[200];
+    int ok = 1;
+    int i;
+
+    for (i = 0; i < 200; i++) {
+        entries[i] = make_entry(1000 + 3 * i, 3);
+        job_table_insert(table, entries[i]);
+    }
+    for (i = 0; i < 200; i++)
+        ok &= job_table_find(table, 1000 + 3 * i + 2) == entries[i];
+    report("job table grows past its first size", table->capacity > JOB_TABLE_MIN_SLOTS);
+    report("job table stays at most 3/4 used", table->used * 4 <= table->capacity * 3);
+    report("job table finds every pid after growing", ok);
+    report("job table misses unknown pids", job_table_find(table, 999) == NULL &&
+           job_table_find(table, 1600) == NULL && job_table_find(table, 0) == NULL);
+
+    for (i = 0; i < 200; i++) {
+        job_table_remove(table, entries[i]);
+        free_entry(entries[i]);
+    }
+    free_job_table(table);
+}
+
+static void test_tombstones(void) {
+    job_table_t* table = create_job_table();
+    bgentry_t* entries[20];
+    bgentry_t* entry;
+    int ok = 1;
+    int i;
+
+    // Leaders JOB_TABLE_MIN_SLOTS apart hash alike, so they share one probe chain
+    for (i = 0; i < 20; i++) {
+        entries[i] = make_entry(5000 + JOB_TABLE_MIN_SLOTS * i, 2);
+        job_table_insert(table, entries[i]);
+    }
+
+    // Reaping a process drops its pid, but not the leader's while others live
+    entry = entries[7];
+    job_table_forget_pid(table, entry, entry->pid);
+    report("job table keeps a live job's leader", job_table_find(table, entry->pid) == entry);
+    entry->pids[1] = -1;
+    entry->nlive--;
+    job_table_forget_pid(table, entry, entry->pid + 1);
+    report("job table forgets a reaped pid", job_table_find(table, entry->pid + 1) == NULL);
+
+    // Freed slots must not cut the chain for the pids after them
+    for (i = 0; i < 20; i += 2)
+        job_table_remove(table, entries[i]);
+    for (i = 0; i < 20; i++)
+        if (i % 2 == 0)
+            ok &= job_table_find(table, entries[i]->pid) == NULL;
+        else
+            ok &= job_table_find(table, entries[i]->pid) == entries[i];
+    report("job table finds pids past freed slots", ok && table->capacity == JOB_TABLE_MIN_SLOTS);
+    for (i = 1; i < 20; i += 2)
+        job_table_remove(table, entries[i]);
+    report("job table empties", table->jobs->length == 0 && job_table_find(table, 5000 + 1) == NULL);
+    for (i = 0; i < 20; i++)
+        free_entry(entries[i]);
+
+    // A long session of short jobs: freed slots are reclaimed, not piled up
+    for (i = 0; i < 20000; i++) {
+        entry = make_entry(10000 + 2 * i, 2);
+        job_table_insert(table, entry);
+        ok &= job_table_find(table, entry->pid + 1) == entry;
+        job_table_remove(table, entry);
+        free_entry(entry);
+    }
+    report("job table reuses freed slots", ok && table->capacity == JOB_TABLE_MIN_SLOTS);
+    free_job_table(table);
+}
+
+static void test_back_links(void) {
+    job_table_t* table = create_job_table();
+    bgentry_t* entries[10];
+    int ok;
+    int i;
+
+    for (i = 0; i < 10; i++) {
+        entries[i] = make_entry(100 + i, 1);
+        job_table_insert(table, entries[i]);
+    }
+    ok = table->jobs->head->data == entries[9] && table->jobs->tail->data == entries[0];
+    report("job list is most recent first", ok && links_consistent(table->jobs));
+
+    job_table_remove(table, entries[5]);
+    job_table_remove(table, entries[9]);
+    job_table_remove(table, entries[0]);
+    ok = table->jobs->head->data == entries[8] && table->jobs->tail->data == entries[1];
+    report("job list keeps its back links through removals",
+           ok && table->jobs->length == 7 && links_consistent(table->jobs));
+
+    for (i = 1; i < 9; i++)
+        if (i != 5)
+            job_table_remove(table, entries[i]);
+    report("job list empties", table->jobs->head == NULL && table->jobs->tail == NULL &&
+           table->jobs->length == 0);
+    for (i = 0; i < 10; i++)
+        free_entry(entries[i]);
+    free_job_table(table);
+}
+
+typedef struct {
+    int key;
+    int seq;    // order of insertion
+} item_t;
+
+static int compare_item(const void* a, const void* b) {
+    return ((const item_t*)a)->key - ((const item_t*)b)->key;
+}
+
+// Sorted by key, and equal keys still in insertion order
+static int sorted_stably(list_t* list) {
+    node_t* node;
+
+    for (node = list->head; node != NULL && node->next != NULL; node = node->next) {
+        item_t* a = node->data;
+        item_t* b = node->next->data;
+        if (a->key > b->key || (a->key == b->key && a->seq > b->seq))
+            return 0;
+    }
+    return 1;
+}
+
+static void test_sort(void) {
+    item_t items[1000];
+    node_t* handles[1000];
+    list_t* list = CreateList(compare_item, NULL, NULL);
+    list_t* ordered = CreateList(compare_item, NULL, NULL);
+    int ok = 1;
+    int i;
+
+    KeepBackLinks(list);
+    srand(53);
+    for (i = 0; i < 1000; i++) {
+        items[i].key = rand() % 10;
+        items[i].seq = i;
+        handles[i] = InsertAtTail(list, &items[i]);
+        InsertInOrder(ordered, &items[i]);
+    }
+    SortList(list);
+    report("merge sort keeps equal keys in order", sorted_stably(list) && list->length == 1000);
+    report("merge sort restores the back links and tail", links_consistent(list));
+    for (i = 0; i < 1000; i++)
+        ok &= handles[i]->data == &items[i];
+    report("merge sort keeps node handles valid", ok);
+    report("insert in order keeps equal keys in order", sorted_stably(ordered));
+
+    for (i = 0; i < 1000; i += 3)
+        RemoveNode(list, handles[i]);
+    SortList(list);
+    report("merge sort after removals", sorted_stably(list) && list->length == 666 &&
+           links_consistent(list));
+
+    DeleteList(list);
+    DeleteList(ordered);
+    free(list);
+    free(ordered);
+}
+
+static void test_pool(void) {
+    static pool_t pool = POOL_INITIALIZER("test", item_t);
+    void* objects[3 * POOL_SLAB_OBJECTS];
+    size_t slabs;
+    int ok = 1;
+    int i;
+
+    for (i = 0; i < 3 * POOL_SLAB_OBJECTS; i++) {
+        objects[i] = pool_alloc(&pool);
+        ok &= objects[i] != NULL;
+        memset(objects[i], 0xa5, sizeof(item_t));
+    }
+    for (i = 0; i < 3 * POOL_SLAB_OBJECTS; i++)
+        pool_free(&pool, objects[i]);
+    report("pool hands out objects", ok);
+    report("pool counts live and peak objects", pool.live == 0 && pool.peak == 3 * POOL_SLAB_OBJECTS);
+
+    // Freed objects are recycled before a new slab is carved
+    slabs = pool.nslabs;
+    for (i = 0; i < 3 * POOL_SLAB_OBJECTS; i++)
+        objects[i] = pool_alloc(&pool);
+    for (i = 0; i < 3 * POOL_SLAB_OBJECTS; i++)
+        pool_free(&pool, objects[i]);
+#ifdef NO_POOLS
+    report("pool falls back to malloc", slabs == 0 && pool.nslabs == 0);
+#else
+    report("pool recycles freed objects", slabs == 3 && pool.nslabs == 3);
+#endif
+}
+
+int main(void) {
+    test_rehash();
+    test_tombstones();
+    test_back_links();
+    test_sort();
+    test_pool();
+    return failed;
+}